@@ -4,16 +4,74 @@
 #  error incompatible _POSIX_C_SOURCE level
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+
+#ifdef _WIN32
+#  include <io.h>
+#else
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <pthread.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
 
 #ifndef PDJSON_H
 #  include "pdjson.h"
 #endif
 
+/* Vector kernels are used where the compiler targets them (e.g. -mavx2),
+   and can be disabled with PDJSON_NO_SIMD. */
+#ifndef PDJSON_NO_SIMD
+#  if defined(__AVX2__)
+#    include <immintrin.h>
+#    define PDJSON_HAVE_AVX2
+#  endif
+#  if defined(__SSSE3__) || defined(__AVX2__)
+#    include <tmmintrin.h>
+#    define PDJSON_HAVE_SSSE3
+#  endif
+#  if defined(__PCLMUL__) && (defined(__x86_64__) || defined(_M_X64))
+#    include <wmmintrin.h>
+#    define PDJSON_HAVE_PCLMUL
+#  endif
+#  if defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define PDJSON_HAVE_SSE2
+#  endif
+#endif
+
 #define JSON_FLAG_ERROR      (1u << 0)
 #define JSON_FLAG_STREAMING  (1u << 1)
+#define JSON_FLAG_BUFFER     (1u << 2)
+#define JSON_FLAG_DEFERRED   (1u << 3)
+#define JSON_FLAG_MAPPED     (1u << 4)
+#define JSON_FLAG_OWNED      (1u << 5)
+#define JSON_FLAG_UTF8       (1u << 6)
+#define JSON_FLAG_RAW_SKIP   (1u << 7)
+#define JSON_FLAG_DISCARD    (1u << 8)
+#define JSON_FLAG_FEED       (1u << 9)
+#define JSON_FLAG_FEED_END   (1u << 10)
+#define JSON_FLAG_STARVED    (1u << 11)
+#define JSON_FLAG_FIXED_STACK  (1u << 12)
+#define JSON_FLAG_FIXED_STRING (1u << 13)
+#define JSON_FLAG_PART         (1u << 14)
+#define JSON_FLAG_COUNTS       (1u << 15)
+#define JSON_FLAG_SKIP         (1u << 16)
+
+/* For json->data.number.flags */
+#define NUMBER_VALID         (1u << 0)
+#define NUMBER_NEGATIVE      (1u << 1)
+#define NUMBER_FULL          (1u << 2)
+#define NUMBER_INEXACT       (1u << 3)
 
 #if defined(_MSC_VER) && (_MSC_VER < 1900)
 
@@ -51,16 +109,49 @@ static void terminate(json_stream *json)
         json->data.string[json->data.string_fill] = '\0';
 }
 
-/* See also PDJSON_STACK_MAX below. */
-#ifndef PDJSON_STACK_INC
-#  define PDJSON_STACK_INC 4
+/* The nesting stack takes four bits a level, two levels to a byte: a
+   bit for an object rather than an array, and two for how far along it
+   is, which is all that json_next() needs of its count. Exact counts
+   are kept beside it only for json_set_counts(). The stack starts with
+   room for PDJSON_STACK_INIT levels and doubles as needed. See also
+   PDJSON_STACK_MAX below. */
+#ifndef PDJSON_STACK_INIT
+#  define PDJSON_STACK_INIT 32
 #endif
 
-struct json_stack {
-    enum json_type type;
-    long count;
+enum {
+    STACK_EMPTY = 0,    /* count is zero */
+    STACK_ODD = 1,      /* count is odd: after a member name */
+    STACK_EVEN = 2,     /* count is even and not zero */
+    STACK_STATE = 3,
+    STACK_OBJECT = 4
 };
 
+static unsigned
+stack_get(const json_stream *json, size_t level)
+{
+    return json->stack[level / 2] >> (level % 2 * 4) & 0xf;
+}
+
+static void
+stack_set(json_stream *json, size_t level, unsigned entry)
+{
+    unsigned shift = level % 2 * 4;
+    unsigned char *byte = &json->stack[level / 2];
+    *byte = (unsigned char)((*byte & ~(0xfu << shift)) | entry << shift);
+}
+
+/* One more item in the container at level. */
+static void
+stack_count(json_stream *json, size_t level)
+{
+    unsigned entry = stack_get(json, level);
+    unsigned state = (entry & STACK_STATE) == STACK_ODD ? STACK_EVEN : STACK_ODD;
+    stack_set(json, level, (entry & ~STACK_STATE) | state);
+    if (json->flags & JSON_FLAG_COUNTS)
+        json->counts[level]++;
+}
+
 static enum json_type
 push(json_stream *json, enum json_type type)
 {
@@ -76,21 +167,42 @@ push(json_stream *json, enum json_type type)
 #endif
 
     if (top >= json->stack_size) {
-        struct json_stack *stack;
-        size_t size = (json->stack_size + PDJSON_STACK_INC) * sizeof(*json->stack);
-        stack = (struct json_stack *)json->alloc.realloc(json->stack, size);
+        unsigned char *stack;
+        size_t size = json->stack_size > 0 ? json->stack_size * 2 : PDJSON_STACK_INIT;
+        if (json->flags & JSON_FLAG_FIXED_STACK) {
+            json_error(json, "%s", "maximum depth of nesting reached");
+            return JSON_ERROR;
+        }
+        stack = (unsigned char *)json->alloc.realloc(json->alloc.ctx, json->stack,
+                                                     json->stack_size / 2, size / 2);
         if (stack == NULL) {
             json_error(json, "%s", "out of memory");
             return JSON_ERROR;
         }
 
-        json->stack_size += PDJSON_STACK_INC;
+        json->stack_size = size;
         json->stack = stack;
     }
 
+    if ((json->flags & JSON_FLAG_COUNTS) && top >= json->counts_size) {
+        size_t *counts;
+        size_t size = json->counts_size > 0 ? json->counts_size * 2 : PDJSON_STACK_INIT;
+        counts = (size_t *)json->alloc.realloc(json->alloc.ctx, json->counts,
+                                               json->counts_size * sizeof(*counts),
+                                               size * sizeof(*counts));
+        if (counts == NULL) {
+            json_error(json, "%s", "out of memory");
+            return JSON_ERROR;
+        }
+
+        json->counts_size = size;
+        json->counts = counts;
+    }
+
     json->stack_top = top;
-    json->stack[top].type = type;
-    json->stack[top].count = 0;
+    stack_set(json, top, type == JSON_OBJECT ? STACK_OBJECT : 0);
+    if (json->flags & JSON_FLAG_COUNTS)
+        json->counts[top] = 0;
 
     return type;
 }
@@ -99,7 +211,8 @@ push(json_stream *json, enum json_type type)
 static enum json_type
 pop(json_stream *json, int c, enum json_type expected)
 {
-    if (json->stack == NULL || json->stack[json->stack_top].type != expected) {
+    unsigned kind = expected == JSON_OBJECT ? STACK_OBJECT : 0;
+    if (json->stack == NULL || (stack_get(json, json->stack_top) & STACK_OBJECT) != kind) {
         json_error(json, "unexpected byte '%c'", c);
         return JSON_ERROR;
     }
@@ -107,22 +220,207 @@ pop(json_stream *json, int c, enum json_type expected)
     return expected == JSON_ARRAY ? JSON_ARRAY_END : JSON_OBJECT_END;
 }
 
+/* Each source presents the bytes it has on hand as a window, [cursor,
+   limit), which the lexer reads directly. Only once the window runs dry
+   does it call through the source's get/peek functions, so the common
+   case costs a compare and an increment rather than an indirect call.
+   The byte position is that of base plus however far cursor has moved.
+ */
+static const unsigned char empty_window[1];
+
+static int source_peek(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    if (source->cursor < source->limit)
+        return *source->cursor;
+    return source->peek(source);
+}
+
+static int source_get(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    if (source->cursor < source->limit)
+        return *source->cursor++;
+    return source->get(source);
+}
+
+/* A buffer is a single window covering all of the input, so once it is
+   exhausted there is nothing more to read. */
 static int buffer_peek(struct json_source *source)
 {
-    if (source->position < source->source.buffer.length)
-        return (unsigned char)source->source.buffer.buffer[source->position];
-    else
-        return EOF;
+    (void)source;
+    return EOF;
 }
 
 static int buffer_get(struct json_source *source)
 {
-    int c = source->peek(source);
-    if (c != EOF)
-        source->position++;
-    return c;
+    (void)source;
+    return EOF;
+}
+
+#ifndef PDJSON_BUFFER_SIZE
+#  define PDJSON_BUFFER_SIZE 65536
+#endif
+
+#ifndef PDJSON_ARENA_CHUNK
+#  define PDJSON_ARENA_CHUNK 4096
+#endif
+
+static json_stream *
+source_owner(struct json_source *source)
+{
+    return (json_stream *)((char *)source - offsetof(json_stream, source));
+}
+
+static unsigned
+popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    unsigned n;
+    for (n = 0; x; x &= x - 1)
+        n++;
+    return n;
+#endif
+}
+
+/* Line numbers are counted lazily. Newlines in the window are only
+   counted when json_get_lineno() asks, or before the window is replaced;
+   source->counted marks how far that has got. They are counted up to
+   source->mark, the start of the latest token (or past the bytes a raw
+   skip or json_source_get() took), and not into the token itself, so
+   that a newline in a bad string does not count, as it would not from a
+   source without a window, whose bytes are counted as they are read. */
+static void
+count_lines(json_stream *json, const unsigned char *p, const unsigned char *end)
+{
+    size_t n = 0;
+#ifdef PDJSON_HAVE_AVX2
+    const __m256i newline32 = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        n += popcount64((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline32)));
+    }
+#endif
+#ifdef PDJSON_HAVE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        n += popcount64((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+    }
+    for (; p < end; p++)
+        n += *p == '\n';
+#else
+    while ((p = (const unsigned char *)memchr(p, '\n', end - p)) != NULL) {
+        n++;
+        p++;
+    }
+#endif
+    json->lineno += n;
+}
+
+/* Sources read in blocks refill the window from their block buffer,
+   which is allocated on first use so that json_set_allocator() and
+   json_set_buffer_size() can still be called after opening. Returns
+   zero at the end of input, or should the read fail.
+ */
+static int
+refill(struct json_source *source,
+       size_t (*read_block)(struct json_source *, unsigned char *, size_t))
+{
+    size_t n;
+
+    json_stream *json = source_owner(source);
+
+    if (source->block == NULL) {
+        source->block = (unsigned char *)json->alloc.malloc(json->alloc.ctx, source->block_size);
+        if (source->block == NULL) {
+            json_error(json, "%s", "out of memory");
+            return 0;
+        }
+    }
+
+    count_lines(json, source->counted, source->mark);
+    source->position += source->cursor - source->base;
+    n = read_block(source, source->block, source->block_size);
+    source->base = source->block;
+    source->cursor = source->block;
+    source->counted = source->block;
+    source->mark = source->block;
+    source->limit = source->block + n;
+    return n > 0;
+}
+
+static size_t
+stream_read(struct json_source *source, unsigned char *buf, size_t size)
+{
+    size_t n = fread(buf, 1, size, source->source.stream.stream);
+    if (n == 0 && ferror(source->source.stream.stream)) {
+        json_stream *json = source_owner(source);
+        json_error(json, "%s", "read error");
+    }
+    return n;
+}
+
+static int stream_block_get(struct json_source *source)
+{
+    return refill(source, stream_read) ? *source->cursor++ : EOF;
+}
+
+static int stream_block_peek(struct json_source *source)
+{
+    return refill(source, stream_read) ? *source->cursor : EOF;
+}
+
+static size_t
+fd_read(struct json_source *source, unsigned char *buf, size_t size)
+{
+    for (;;) {
+        long n = read(source->source.fd.fd, buf, size);
+        if (n >= 0)
+            return n;
+        if (errno != EINTR) {
+            json_stream *json = source_owner(source);
+            json_error(json, "%s", strerror(errno));
+            return 0;
+        }
+    }
+}
+
+static int fd_get(struct json_source *source)
+{
+    return refill(source, fd_read) ? *source->cursor++ : EOF;
+}
+
+static int fd_peek(struct json_source *source)
+{
+    return refill(source, fd_read) ? *source->cursor : EOF;
+}
+
+static size_t
+reader_read(struct json_source *source, unsigned char *buf, size_t size)
+{
+    long n = source->source.reader.read(source->source.reader.ptr, buf, size);
+    if (n < 0) {
+        json_stream *json = source_owner(source);
+        json_error(json, "%s", "read error");
+        return 0;
+    }
+    return (size_t)n < size ? (size_t)n : size;
+}
+
+static int reader_get(struct json_source *source)
+{
+    return refill(source, reader_read) ? *source->cursor++ : EOF;
+}
+
+static int reader_peek(struct json_source *source)
+{
+    return refill(source, reader_read) ? *source->cursor : EOF;
 }
 
+/* Unbuffered FILE source, for a buffer size of zero. */
 static int stream_get(struct json_source *source)
 {
     int c = fgetc(source->source.stream.stream);
@@ -138,6 +436,70 @@ static int stream_peek(struct json_source *source)
     return c;
 }
 
+/* Allocators without a context are called through these, with the
+   stream's copy of the allocator as the context. */
+static void *
+plain_malloc(void *ctx, size_t size)
+{
+    return ((struct json_allocator *)ctx)->malloc(size);
+}
+
+static void *
+plain_realloc(void *ctx, void *ptr, size_t old_size, size_t size)
+{
+    (void)old_size;
+    return ((struct json_allocator *)ctx)->realloc(ptr, size);
+}
+
+static void
+plain_free(void *ctx, void *ptr, size_t size)
+{
+    (void)size;
+    ((struct json_allocator *)ctx)->free(ptr);
+}
+
+static void
+set_plain_allocator(json_stream *json)
+{
+    json->alloc.malloc = plain_malloc;
+    json->alloc.realloc = plain_realloc;
+    json->alloc.free = plain_free;
+    json->alloc.ctx = &json->plain;
+}
+
+/* Give back the stack, string buffer and counts, other than storage the
+   caller supplied, through the allocator they came from. */
+static void
+release_buffers(json_stream *json)
+{
+    if (!(json->flags & JSON_FLAG_FIXED_STACK) && json->stack != NULL) {
+        json->alloc.free(json->alloc.ctx, json->stack, json->stack_size / 2);
+        json->stack = NULL;
+        json->stack_size = 0;
+    }
+    if (!(json->flags & JSON_FLAG_FIXED_STRING) && json->data.string != NULL) {
+        json->alloc.free(json->alloc.ctx, json->data.string, json->data.string_size);
+        json->data.string = NULL;
+        json->data.string_size = 0;
+        json->data.string_fill = 0;
+    }
+    if (json->counts != NULL) {
+        json->alloc.free(json->alloc.ctx, json->counts,
+                         json->counts_size * sizeof(*json->counts));
+        json->counts = NULL;
+        json->counts_size = 0;
+    }
+}
+
+/* Before the first event those buffers hold nothing, and are released
+   so that a different allocator can take over. */
+static void
+release_idle(json_stream *json)
+{
+    if (json->ntokens == 0 && json->stack_top == (size_t)-1)
+        release_buffers(json);
+}
+
 static void init(json_stream *json)
 {
     json->lineno = 1;
@@ -147,17 +509,34 @@ static void init(json_stream *json)
     json->next = (enum json_type)0;
 
     json->stack = NULL;
+    json->counts = NULL;
+    json->counts_size = 0;
     json->stack_top = -1;
     json->stack_size = 0;
 
     json->data.string = NULL;
     json->data.string_size = 0;
     json->data.string_fill = 0;
+    json->data.slice = NULL;
+    json->data.slice_length = 0;
+    json->data.part_size = 0;
+    json->data.number.flags = 0;
     json->source.position = 0;
+    json->source.base = empty_window;
+    json->source.counted = empty_window;
+    json->source.mark = empty_window;
+    json->source.cursor = empty_window;
+    json->source.limit = empty_window;
+    json->source.block = NULL;
+    json->source.block_size = PDJSON_BUFFER_SIZE;
+    json->source.index = NULL;
+    json->source.index_size = 0;
+    json->source.index_next = 0;
 
-    json->alloc.malloc = malloc;
-    json->alloc.realloc = realloc;
-    json->alloc.free = free;
+    json->plain.malloc = malloc;
+    json->plain.realloc = realloc;
+    json->plain.free = free;
+    set_plain_allocator(json);
 }
 
 static enum json_type
@@ -165,7 +544,7 @@ is_match(json_stream *json, const char *pattern, enum json_type type)
 {
     int c;
     for (const char *p = pattern; *p; p++) {
-        if (*p != (c = json->source.get(&json->source))) {
+        if (*p != (c = source_get(json))) {
             if (c != EOF) {
                 json_error(json, "expected '%c' instead of byte '%c'", *p, c);
             } else {
@@ -179,11 +558,19 @@ is_match(json_stream *json, const char *pattern, enum json_type type)
 
 static int pushchar(json_stream *json, int c)
 {
+    if (json->flags & JSON_FLAG_DISCARD)
+        return 0;
     /* Keep one byte in reserve so that terminate() always has somewhere
        to put its terminator. */
     if (json->data.string_fill + 1 == json->data.string_size) {
         size_t size = json->data.string_size * 2;
-        char *buffer = (char *)json->alloc.realloc(json->data.string, size);
+        char *buffer;
+        if (json->flags & JSON_FLAG_FIXED_STRING) {
+            json_error(json, "%s", "maximum length of token reached");
+            return -1;
+        }
+        buffer = (char *)json->alloc.realloc(json->alloc.ctx, json->data.string,
+                                             json->data.string_size, size);
         if (buffer == NULL) {
             json_error(json, "%s", "out of memory");
             return -1;
@@ -196,12 +583,47 @@ static int pushchar(json_stream *json, int c)
     return 0;
 }
 
+/* Append a run of bytes with a single copy, growing the buffer at most
+   once. The same reserve byte as pushchar() is kept. */
+static int pushbytes(json_stream *json, const void *bytes, size_t n)
+{
+    size_t need = json->data.string_fill + n + 1;
+    if (json->flags & JSON_FLAG_DISCARD)
+        return 0;
+    if (need > json->data.string_size) {
+        size_t size = json->data.string_size;
+        char *buffer;
+        if (json->flags & JSON_FLAG_FIXED_STRING) {
+            json_error(json, "%s", "maximum length of token reached");
+            return -1;
+        }
+        while (size < need)
+            size *= 2;
+        buffer = (char *)json->alloc.realloc(json->alloc.ctx, json->data.string,
+                                             json->data.string_size, size);
+        if (buffer == NULL) {
+            json_error(json, "%s", "out of memory");
+            return -1;
+        }
+        json->data.string_size = size;
+        json->data.string = buffer;
+    }
+    memcpy(json->data.string + json->data.string_fill, bytes, n);
+    json->data.string_fill += n;
+    return 0;
+}
+
 static int init_string(json_stream *json)
 {
     json->data.string_fill = 0;
+    json->data.slice = NULL;
+    json->data.number.mantissa = 0;
+    json->data.number.exponent = 0;
+    json->data.number.flags = 0;
+    json->flags &= ~JSON_FLAG_DEFERRED;
     if (json->data.string == NULL) {
         json->data.string_size = 1024;
-        json->data.string = (char *)json->alloc.malloc(json->data.string_size);
+        json->data.string = (char *)json->alloc.malloc(json->alloc.ctx, json->data.string_size);
         if (json->data.string == NULL) {
             json_error(json, "%s", "out of memory");
             return -1;
@@ -274,7 +696,7 @@ read_unicode_cp(json_stream *json)
     int shift = 12;
 
     for (size_t i = 0; i < 4; i++) {
-        int c = json->source.get(&json->source);
+        int c = source_get(json);
         int hc;
 
         if (c == EOF) {
@@ -307,7 +729,7 @@ static int read_unicode(json_stream *json)
          */
         h = cp;
 
-        int c = json->source.get(&json->source);
+        int c = source_get(json);
         if (c == EOF) {
             json_error(json, "%s", "unterminated string literal in Unicode");
             return -1;
@@ -317,7 +739,7 @@ static int read_unicode(json_stream *json)
             return -1;
         }
 
-        c = json->source.get(&json->source);
+        c = source_get(json);
         if (c == EOF) {
             json_error(json, "%s", "unterminated string literal in Unicode");
             return -1;
@@ -349,7 +771,7 @@ static int read_unicode(json_stream *json)
 static int
 read_escaped(json_stream *json)
 {
-    int c = json->source.get(&json->source);
+    int c = source_get(json);
     if (c == EOF) {
         json_error(json, "%s", "unterminated string literal in escape");
         return -1;
@@ -391,6 +813,73 @@ char_needs_escaping(int c)
     return 0;
 }
 
+#if defined(PDJSON_HAVE_SSE2) || defined(PDJSON_HAVE_AVX2)
+static unsigned
+first_bit(unsigned long mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzl(mask);
+#else
+    unsigned n = 0;
+    for (; !(mask & 1); mask >>= 1)
+        n++;
+    return n;
+#endif
+}
+#endif
+
+/* Return the first byte in [p, end) that cannot be copied into a string
+   as is: a quote, a backslash, a control character, or, unless text is
+   set, any byte of a multi-byte UTF-8 sequence. Compared as signed bytes,
+   both the control characters and the bytes >= 0x80 are less than 0x20,
+   so one comparison catches them both; an unsigned minimum tells the
+   control characters apart on their own.
+ */
+static const unsigned char *
+scan_string(const unsigned char *p, const unsigned char *end, int text)
+{
+#ifdef PDJSON_HAVE_AVX2
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i slash32 = _mm256_set1_epi8('\\');
+    const __m256i space32 = _mm256_set1_epi8(0x20);
+    const __m256i ctrl32 = _mm256_set1_epi8(0x1f);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i c = text
+            ? _mm256_cmpeq_epi8(_mm256_min_epu8(v, ctrl32), v)
+            : _mm256_cmpgt_epi8(space32, v);
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote32),
+                            _mm256_cmpeq_epi8(v, slash32)), c);
+        unsigned long mask = (unsigned)_mm256_movemask_epi8(m);
+        if (mask)
+            return p + first_bit(mask);
+    }
+#endif
+#ifdef PDJSON_HAVE_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i ctrl = _mm_set1_epi8(0x1f);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i c = text
+            ? _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v)
+            : _mm_cmplt_epi8(v, space);
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+            c);
+        unsigned long mask = (unsigned)_mm_movemask_epi8(m);
+        if (mask)
+            return p + first_bit(mask);
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == '"' || *p == '\\' || *p < 0x20 || (*p >= 0x80 && !text))
+            break;
+    return p;
+}
+
 static int
 utf8_seq_length(char byte)
 {
@@ -476,6 +965,232 @@ is_legal_utf8(const unsigned char *bytes, int length)
     return *bytes <= 0xF4;
 }
 
+/* Return the end of the valid UTF-8 at the start of [p, end), short of
+   any sequence that is malformed or runs past end. */
+static const unsigned char *
+utf8_prefix(const unsigned char *p, const unsigned char *end)
+{
+    while (p < end) {
+        int n;
+#ifdef PDJSON_HAVE_SSE2
+        if (end - p >= 16 &&
+            !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p))) {
+            p += 16;
+            continue;
+        }
+#endif
+        if (*p < 0x80) {
+            p++;
+            continue;
+        }
+        n = utf8_seq_length(*p);
+        if (!n || end - p < n || !is_legal_utf8(p, n))
+            break;
+        p += n;
+    }
+    return p;
+}
+
+#if defined(PDJSON_HAVE_SSSE3)
+/* Lookup tables for the vector UTF-8 check, after Keiser and Lemire,
+   "Validating UTF-8 In Less Than One Instruction Per Byte". Each pair of
+   adjacent bytes is classified three ways, by the high and low nibble of
+   the first and the high nibble of the second, and a bit survives the
+   conjunction only where the pair is one of the errors below. Whether a
+   continuation byte is wanted at all depends on the bytes two and three
+   back, and is settled separately.
+ */
+#define UTF8_TOO_SHORT   (1 << 0) /* lead byte not followed by continuation */
+#define UTF8_TOO_LONG    (1 << 1) /* ASCII followed by continuation */
+#define UTF8_OVERLONG_3  (1 << 2)
+#define UTF8_TOO_LARGE   (1 << 3) /* beyond U+10FFFF */
+#define UTF8_SURROGATE   (1 << 4)
+#define UTF8_OVERLONG_2  (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4  (1 << 6)
+#define UTF8_TWO_CONTS   (1 << 7) /* continuation after continuation */
+#define UTF8_CARRY       (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const unsigned char utf8_byte_1_high[16] = {
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+};
+
+static const unsigned char utf8_byte_1_low[16] = {
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    UTF8_CARRY,
+    UTF8_CARRY,
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+};
+
+static const unsigned char utf8_byte_2_high[16] = {
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS |
+        UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS |
+        UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS |
+        UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS |
+        UTF8_SURROGATE | UTF8_TOO_LARGE,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+};
+
+/* The last bytes of a block that leave a sequence to be finished in the
+   next one: a lead byte of any length in the last position, of three or
+   four bytes in the one before, and of four bytes in the one before that.
+   Only bytes above these limits count.
+ */
+static const unsigned char utf8_limit[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+};
+
+#if defined(PDJSON_HAVE_AVX2)
+typedef __m256i utf8_block;
+#  define UTF8_BLOCK 32
+#  define v_load(p)       _mm256_loadu_si256((const __m256i *)(p))
+#  define v_set1(b)       _mm256_set1_epi8(b)
+#  define v_and           _mm256_and_si256
+#  define v_or            _mm256_or_si256
+#  define v_xor           _mm256_xor_si256
+#  define v_subs          _mm256_subs_epu8
+#  define v_lookup(t, i)  _mm256_shuffle_epi8(t, i)
+#  define v_nibble(v)     v_and(_mm256_srli_epi16(v, 4), v_set1(0x0f))
+#  define v_any(v)        !_mm256_testz_si256(v, v)
+#  define v_ascii(v)      !_mm256_movemask_epi8(v)
+#  define v_prev(v, p, n) \
+    _mm256_alignr_epi8(v, _mm256_permute2x128_si256(p, v, 0x21), 16 - (n))
+#  define v_table(t) \
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(t)))
+#else
+typedef __m128i utf8_block;
+#  define UTF8_BLOCK 16
+#  define v_load(p)       _mm_loadu_si128((const __m128i *)(p))
+#  define v_set1(b)       _mm_set1_epi8(b)
+#  define v_and           _mm_and_si128
+#  define v_or            _mm_or_si128
+#  define v_xor           _mm_xor_si128
+#  define v_subs          _mm_subs_epu8
+#  define v_lookup(t, i)  _mm_shuffle_epi8(t, i)
+#  define v_nibble(v)     v_and(_mm_srli_epi16(v, 4), v_set1(0x0f))
+#  define v_any(v)        (_mm_movemask_epi8(_mm_cmpeq_epi8(v, \
+                               _mm_setzero_si128())) != 0xffff)
+#  define v_ascii(v)      !_mm_movemask_epi8(v)
+#  define v_prev(v, p, n) _mm_alignr_epi8(v, p, 16 - (n))
+#  define v_table(t)      v_load(t)
+#endif
+
+/* Validate [p, end) as UTF-8 a block at a time, carrying the previous
+   block along so that sequences may straddle two. */
+static int
+utf8_valid(const unsigned char *p, const unsigned char *end)
+{
+    const utf8_block byte_1_high = v_table(utf8_byte_1_high);
+    const utf8_block byte_1_low = v_table(utf8_byte_1_low);
+    const utf8_block byte_2_high = v_table(utf8_byte_2_high);
+    const utf8_block limit = v_load(utf8_limit + 32 - UTF8_BLOCK);
+    unsigned char tail[UTF8_BLOCK];
+    utf8_block prev = v_set1(0);
+    utf8_block pending = v_set1(0);
+    utf8_block error = v_set1(0);
+
+    while (p < end) {
+        utf8_block v, prev1;
+        if (end - p >= UTF8_BLOCK) {
+            v = v_load(p);
+            p += UTF8_BLOCK;
+        } else {
+            /* Pad the tail with nul bytes, which cut short any sequence
+               left unfinished. */
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, end - p);
+            v = v_load(tail);
+            p = end;
+        }
+
+        if (v_ascii(v)) {
+            error = v_or(error, pending);
+            pending = v_set1(0);
+            prev = v;
+            continue;
+        }
+
+        prev1 = v_prev(v, prev, 1);
+        error = v_or(error, v_xor(
+            v_and(v_and(v_lookup(byte_1_high, v_nibble(prev1)),
+                        v_lookup(byte_1_low, v_and(prev1, v_set1(0x0f)))),
+                  v_lookup(byte_2_high, v_nibble(v))),
+            v_and(v_or(v_subs(v_prev(v, prev, 2), v_set1((char)(0xe0 - 0x80))),
+                       v_subs(v_prev(v, prev, 3), v_set1((char)(0xf0 - 0x80)))),
+                  v_set1((char)0x80))));
+        pending = v_subs(v, limit);
+        prev = v;
+    }
+
+    return !v_any(v_or(error, pending));
+}
+
+#undef v_load
+#undef v_set1
+#undef v_and
+#undef v_or
+#undef v_xor
+#undef v_subs
+#undef v_lookup
+#undef v_nibble
+#undef v_any
+#undef v_ascii
+#undef v_prev
+#undef v_table
+#else
+static int
+utf8_valid(const unsigned char *p, const unsigned char *end)
+{
+    return utf8_prefix(p, end) == end;
+}
+#endif
+
+/* Return the end of the run of plain string content starting at p, which
+   takes in any valid UTF-8 text along with the ASCII. Non-ASCII text is
+   checked a whole run at a time (unless the buffer was checked as a
+   whole up front), and only if that fails is it walked again to find
+   where, leaving the offending sequence to read_utf8().
+ */
+static const unsigned char *
+scan_plain(json_stream *json, const unsigned char *p, const unsigned char *end)
+{
+    if (json->flags & JSON_FLAG_UTF8)
+        return scan_string(p, end, 1);
+    while ((p = scan_string(p, end, 0)) != end && *p >= 0x80) {
+        const unsigned char *q = scan_string(p, end, 1);
+        if (!utf8_valid(p, q))
+            return utf8_prefix(p, q);
+        p = q;
+    }
+    return p;
+}
+
 static int
 read_utf8(json_stream* json, int next_char)
 {
@@ -491,7 +1206,7 @@ read_utf8(json_stream* json, int next_char)
     int i;
     for (i = 1; i < count; ++i)
     {
-        buffer[i] = json->source.get(&json->source);
+        buffer[i] = source_get(json);
     }
 
     if (!is_legal_utf8((unsigned char*) buffer, count))
@@ -508,13 +1223,71 @@ read_utf8(json_stream* json, int next_char)
     return 0;
 }
 
+/* With a buffer source an escape-free string can be left where it is, and
+   only copied out if json_get_string() asks for it. Returns 1 with the
+   string recorded as a slice once the closing quote is found. Otherwise
+   returns 0 having copied what it got through, stopping short of the
+   first byte it cannot vouch for, for read_string() to carry on from.
+ */
+static int
+slice_string(json_stream *json)
+{
+    const unsigned char *start = json->source.cursor;
+    const unsigned char *end = json->source.limit;
+    const unsigned char *p = scan_plain(json, start, end);
+
+    if (p != end && *p == '"') {
+        json->data.slice = (const char *)start;
+        json->data.slice_length = p - start;
+        json->flags |= JSON_FLAG_DEFERRED;
+        json->source.cursor = p + 1;
+        return 1;
+    }
+
+    /* Only a part's worth is copied, ending between characters */
+    if (json->data.part_size != 0 && (size_t)(p - start) > json->data.part_size) {
+        p = start + json->data.part_size;
+        while ((*p & 0xc0) == 0x80)
+            p--;
+    }
+    json->source.cursor = p;
+    return pushbytes(json, start, p - start);
+}
+
+/* The body of a string, up to and including its closing quote. With
+   json_set_string_parts(), it stops instead, between characters, once
+   the part size has been reached, and json_next() carries on from there
+   with JSON_FLAG_PART set. */
 static enum json_type
-read_string(json_stream *json)
+string_body(json_stream *json)
 {
-    if (init_string(json) != 0)
-        return JSON_ERROR;
+    size_t part = json->data.part_size;
     while (1) {
-        int c = json->source.get(&json->source);
+        /* Copy the plain run ahead of the cursor in one go, and leave
+           whatever stopped it to the byte at a time handling below. */
+        const unsigned char *run = json->source.cursor;
+        const unsigned char *end = json->source.limit;
+        const unsigned char *stop;
+        if (part != 0) {
+            if (json->data.string_fill >= part && source_peek(json) != '"') {
+                if (pushchar(json, '\0') != 0)
+                    return JSON_ERROR;
+                json->flags |= JSON_FLAG_PART;
+                return JSON_STRING_PART;
+            }
+            if ((size_t)(end - run) > part - json->data.string_fill)
+                end = run + (part - json->data.string_fill);
+        }
+        stop = scan_plain(json, run, end);
+        if (stop != run) {
+            if (pushbytes(json, run, stop - run) != 0)
+                return JSON_ERROR;
+            json->source.cursor = stop;
+            if (stop == end && end != json->source.limit)
+                continue;
+        }
+
+        int c = source_get(json);
         if (c == EOF) {
             json_error(json, "%s", "unterminated string literal");
             return JSON_ERROR;
@@ -542,20 +1315,60 @@ read_string(json_stream *json)
     return JSON_ERROR;
 }
 
+static enum json_type
+read_string(json_stream *json)
+{
+    if (init_string(json) != 0)
+        return JSON_ERROR;
+    if (json->flags & JSON_FLAG_BUFFER) {
+        int r = slice_string(json);
+        if (r != 0)
+            return r > 0 ? JSON_STRING : JSON_ERROR;
+    }
+    return string_body(json);
+}
+
 static int
 is_digit(int c)
 {
     return c >= 48 /*0*/ && c <= 57 /*9*/;
 }
 
+/* Parts of a number, as far as read_digits() is concerned. */
+enum { DIGITS_INTEGER, DIGITS_FRACTION, DIGITS_EXPONENT };
+
+/* Fold a digit of the integer or fraction part into the mantissa as it
+   is read. Once the mantissa is full, later digits only scale the
+   exponent, and any that are not zero make the value inexact. */
+static void
+add_digit(struct json_number *n, int c, int part)
+{
+    uint64_t d = c - '0';
+    if (!(n->flags & NUMBER_FULL) && n->mantissa <= (UINT64_MAX - d) / 10) {
+        n->mantissa = n->mantissa * 10 + d;
+        n->exponent -= part == DIGITS_FRACTION;
+    } else {
+        n->flags |= NUMBER_FULL;
+        n->exponent += part == DIGITS_INTEGER;
+        if (d != 0)
+            n->flags |= NUMBER_INEXACT;
+    }
+}
+
+/* Exponent digits are gathered into *power instead, saturating well
+   beyond the range of any double. */
 static int
-read_digits(json_stream *json)
+read_digits(json_stream *json, int part, long *power)
 {
     int c;
     unsigned nread = 0;
-    while (is_digit(c = json->source.peek(&json->source))) {
-        if (pushchar(json, json->source.get(&json->source)) != 0)
+    while (is_digit(c = source_peek(json))) {
+        if (pushchar(json, source_get(json)) != 0)
             return -1;
+        if (part != DIGITS_EXPONENT)
+            add_digit(&json->data.number, c, part);
+        else if (*power < 100000)
+            *power = *power * 10 + (c - '0');
 
         nread++;
     }
@@ -575,10 +1388,14 @@ read_digits(json_stream *json)
 static enum json_type
 read_number(json_stream *json, int c)
 {
+    long power = 0;
+    int sign = 1;
+
     if (pushchar(json, c) != 0)
         return JSON_ERROR;
     if (c == '-') {
-        c = json->source.get(&json->source);
+        json->data.number.flags |= NUMBER_NEGATIVE;
+        c = source_get(json);
         if (is_digit(c)) {
             return read_number(json, c);
         } else {
@@ -589,43 +1406,40 @@ read_number(json_stream *json, int c)
             }
             return JSON_ERROR;
         }
-    } else if (strchr("123456789", c) != NULL) {
-        c = json->source.peek(&json->source);
+    }
+    add_digit(&json->data.number, c, DIGITS_INTEGER);
+    if (strchr("123456789", c) != NULL) {
+        c = source_peek(json);
         if (is_digit(c)) {
-            if (read_digits(json) != 0)
+            if (read_digits(json, DIGITS_INTEGER, NULL) != 0)
                 return JSON_ERROR;
         }
     }
     /* Up to decimal or exponent has been read. */
-    c = json->source.peek(&json->source);
-    if (strchr(".eE", c) == NULL) {
-        if (pushchar(json, '\0') != 0)
-            return JSON_ERROR;
-        else
-            return JSON_NUMBER;
-    }
+    c = source_peek(json);
     if (c == '.') {
-        json->source.get(&json->source); // consume .
+        source_get(json); // consume .
         if (pushchar(json, c) != 0)
             return JSON_ERROR;
-        if (read_digits(json) != 0)
+        if (read_digits(json, DIGITS_FRACTION, NULL) != 0)
             return JSON_ERROR;
     }
     /* Check for exponent. */
-    c = json->source.peek(&json->source);
+    c = source_peek(json);
     if (c == 'e' || c == 'E') {
-        json->source.get(&json->source); // consume e/E
+        source_get(json); // consume e/E
         if (pushchar(json, c) != 0)
             return JSON_ERROR;
-        c = json->source.peek(&json->source);
+        c = source_peek(json);
         if (c == '+' || c == '-') {
-            json->source.get(&json->source); // consume
+            source_get(json); // consume
             if (pushchar(json, c) != 0)
                 return JSON_ERROR;
-            if (read_digits(json) != 0)
+            sign = c == '-' ? -1 : 1;
+            if (read_digits(json, DIGITS_EXPONENT, &power) != 0)
                 return JSON_ERROR;
         } else if (is_digit(c)) {
-            if (read_digits(json) != 0)
+            if (read_digits(json, DIGITS_EXPONENT, &power) != 0)
                 return JSON_ERROR;
         } else {
             if (c != EOF) {
@@ -636,6 +1450,8 @@ read_number(json_stream *json, int c)
             return JSON_ERROR;
         }
     }
+    json->data.number.exponent += sign * power;
+    json->data.number.flags |= NUMBER_VALID;
     if (pushchar(json, '\0') != 0)
         return JSON_ERROR;
     else
@@ -656,31 +1472,223 @@ json_isspace(int c)
     return false;
 }
 
-/* Returns the next non-whitespace character in the stream. */
-static int next(json_stream *json)
+/* A buffer can be indexed ahead of parsing by json_build_index(), which
+   finds every bracket outside of strings. It takes the buffer 64 bytes
+   at a time as bitmaps, in the manner of simdjson: quotes escaped by a
+   backslash are masked out, and a prefix XOR over those left (a
+   carry-less multiply, where there is one) marks the inside of every
+   string. The raw skip can then go from one bracket to the next without
+   looking at anything in between. The same bitmaps serve the raw skip
+   of a window that has no index.
+ */
+struct index_masks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t open;    /* '[' or '{' */
+    uint64_t close;   /* ']' or '}' */
+};
+
+static unsigned
+ctz64(uint64_t x)
 {
-   int c;
-   while (json_isspace(c = json->source.get(&json->source)))
-       if (c == '\n')
-           json->lineno++;
-   return c;
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    for (; !(x & 1); x >>= 1)
+        n++;
+    return n;
+#endif
 }
 
-static enum json_type
-read_value(json_stream *json, int c)
+static void
+index_classify(const unsigned char *p, struct index_masks *m)
 {
-    json->ntokens++;
-    switch (c) {
-    case EOF:
-        json_error(json, "%s", "unexpected end of text");
-        return JSON_ERROR;
-    case '{':
-        return push(json, JSON_OBJECT);
-    case '[':
-        return push(json, JSON_ARRAY);
-    case '"':
-        return read_string(json);
-    case 'n':
+    int i;
+#if defined(PDJSON_HAVE_AVX2)
+    m->quote = m->backslash = m->open = m->close = 0;
+    for (i = 0; i < 64; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        /* '[' and ']' are '{' and '}' less 0x20 */
+        __m256i open = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{'));
+        __m256i close = _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'));
+        m->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+        m->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+        m->open |= (uint64_t)(uint32_t)_mm256_movemask_epi8(open) << i;
+        m->close |= (uint64_t)(uint32_t)_mm256_movemask_epi8(close) << i;
+    }
+#elif defined(PDJSON_HAVE_SSE2)
+    m->quote = m->backslash = m->open = m->close = 0;
+    for (i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i open = _mm_cmpeq_epi8(lower, _mm_set1_epi8('{'));
+        __m128i close = _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'));
+        m->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+        m->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+        m->open |= (uint64_t)(uint16_t)_mm_movemask_epi8(open) << i;
+        m->close |= (uint64_t)(uint16_t)_mm_movemask_epi8(close) << i;
+    }
+#else
+    m->quote = m->backslash = m->open = m->close = 0;
+    for (i = 0; i < 64; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (p[i]) {
+        case '"':
+            m->quote |= bit;
+            break;
+        case '\\':
+            m->backslash |= bit;
+            break;
+        case '{': case '[':
+            m->open |= bit;
+            break;
+        case '}': case ']':
+            m->close |= bit;
+            break;
+        }
+    }
+#endif
+}
+
+/* Each bit set to the parity of the bits up to and including it. */
+static uint64_t
+prefix_xor(uint64_t x)
+{
+#if defined(PDJSON_HAVE_PCLMUL)
+    __m128i ones = _mm_set1_epi8((char)0xff);
+    __m128i v = _mm_set_epi64x(0, (long long)x);
+    return (uint64_t)_mm_cvtsi128_si64(_mm_clmulepi64_si128(v, ones, 0));
+#else
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+#endif
+}
+
+/* The bytes escaped by a backslash that is not itself escaped. These are
+   rare enough to take one at a time. *carry holds whether the previous
+   block ended on such a backslash, and then this one. */
+static uint64_t
+index_escaped(uint64_t backslash, uint64_t *carry)
+{
+    uint64_t escaped = *carry;
+    backslash &= ~escaped;
+    *carry = 0;
+    while (backslash) {
+        unsigned i = ctz64(backslash);
+        if (i == 63) {
+            *carry = 1;
+            break;
+        }
+        escaped |= (uint64_t)2 << i;
+        backslash &= ~((uint64_t)3 << i);
+    }
+    return escaped;
+}
+
+/* Write out the offset of each bit set, four at a time without regard to
+   the count, which leaves up to three stray entries past the end for the
+   next block to overwrite. Returns the count. */
+static unsigned
+index_flatten(uint32_t *out, uint32_t at, uint64_t bits)
+{
+    const uint64_t top = (uint64_t)1 << 63;
+    unsigned i, n = popcount64(bits);
+    for (i = 0; i < n; i += 4) {
+        out[i + 0] = at + ctz64(bits | top);
+        bits &= bits - 1;
+        out[i + 1] = at + ctz64(bits | top);
+        bits &= bits - 1;
+        out[i + 2] = at + ctz64(bits | top);
+        bits &= bits - 1;
+        out[i + 3] = at + ctz64(bits | top);
+        bits &= bits - 1;
+    }
+    return n;
+}
+
+/* The first byte in [p, end) that is not whitespace. Most runs are a
+   single space or none, which are looked at before any vector is. */
+static const unsigned char *
+skip_space(const unsigned char *p, const unsigned char *end)
+{
+    if (p == end || !json_isspace(*p) || ++p == end || !json_isspace(*p))
+        return p;
+#ifdef PDJSON_HAVE_AVX2
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        __m256i space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        unsigned long mask = ~(unsigned)_mm256_movemask_epi8(space) & 0xffffffffu;
+        if (mask)
+            return p + first_bit(mask);
+    }
+#endif
+#ifdef PDJSON_HAVE_SSE2
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        unsigned long mask = ~(unsigned)_mm_movemask_epi8(space) & 0xffffu;
+        if (mask)
+            return p + first_bit(mask);
+    }
+#endif
+    while (p < end && json_isspace(*p))
+        p++;
+    return p;
+}
+
+/* Returns the next non-whitespace character in the stream. Whitespace in
+   the window is skipped a run at a time, and its newlines left to
+   count_lines(); a byte read with the cursor still at the base of the
+   window did not come from one. */
+static int next(json_stream *json)
+{
+   struct json_source *source = &json->source;
+   int c;
+   for (;;) {
+       source->cursor = skip_space(source->cursor, source->limit);
+       source->mark = source->cursor;
+       c = source_get(json);
+       if (!json_isspace(c))
+           return c;
+       if (c == '\n' && source->cursor == source->base)
+           json->lineno++;
+   }
+}
+
+static enum json_type
+read_value(json_stream *json, int c)
+{
+    json->ntokens++;
+    switch (c) {
+    case EOF:
+        json_error(json, "%s", "unexpected end of text");
+        return JSON_ERROR;
+    case '{':
+        return push(json, JSON_OBJECT);
+    case '[':
+        return push(json, JSON_ARRAY);
+    case '"':
+        return read_string(json);
+    case 'n':
         return is_match(json, "ull", JSON_NULL);
     case 'f':
         return is_match(json, "alse", JSON_FALSE);
@@ -699,7 +1707,15 @@ read_value(json_stream *json, int c)
     case '-':
         if (init_string(json) != 0)
             return JSON_ERROR;
-        return read_number(json, c);
+        if (read_number(json, c) != JSON_NUMBER)
+            return JSON_ERROR;
+        if ((json->flags & (JSON_FLAG_BUFFER | JSON_FLAG_DISCARD)) == JSON_FLAG_BUFFER) {
+            /* Numbers are copied regardless, but can be sliced too. */
+            size_t length = json->data.string_fill - 1;
+            json->data.slice = (const char *)json->source.cursor - length;
+            json->data.slice_length = length;
+        }
+        return JSON_NUMBER;
     default:
         json_error(json, "unexpected byte '%c' in value", c);
         return JSON_ERROR;
@@ -716,8 +1732,8 @@ read_element(json_stream *json, int c)
 {
     size_t top = json->stack_top;
     enum json_type value = read_value(json, c);
-    if (value != JSON_ERROR)
-        json->stack[top].count++;
+    if (value != JSON_ERROR && value != JSON_STRING_PART)
+        stack_count(json, top);
     return value;
 }
 
@@ -726,12 +1742,13 @@ enum json_type json_peek(json_stream *json)
     enum json_type next;
     if (json->next)
         next = json->next;
-    else
-        next = json->next = json_next(json);
+    else if ((next = json_next(json)) != JSON_INCOMPLETE)
+        json->next = next;
     return next;
 }
 
-enum json_type json_next(json_stream *json)
+static enum json_type
+next_event(json_stream *json)
 {
     if (json->flags & JSON_FLAG_ERROR)
         return JSON_ERROR;
@@ -740,6 +1757,16 @@ enum json_type json_next(json_stream *json)
         json->next = (enum json_type)0;
         return next;
     }
+    if (json->flags & JSON_FLAG_PART) {
+        /* The string goes on, and counts once it is done */
+        enum json_type type;
+        json->flags &= ~JSON_FLAG_PART;
+        json->data.string_fill = 0;
+        type = string_body(json);
+        if (type == JSON_STRING && json->stack_top != (size_t)-1)
+            stack_count(json, json->stack_top);
+        return type;
+    }
     if (json->ntokens > 0 && json->stack_top == (size_t)-1) {
 
         /* In the streaming mode leave any trailing whitespaces in the stream.
@@ -751,9 +1778,9 @@ enum json_type json_next(json_stream *json)
             int c;
 
             do {
-                c = json->source.peek(&json->source);
+                c = source_peek(json);
                 if (json_isspace(c)) {
-                    c = json->source.get(&json->source);
+                    c = source_get(json);
                 }
             } while (json_isspace(c));
 
@@ -772,8 +1799,10 @@ enum json_type json_next(json_stream *json)
 
         return read_value(json, c);
     }
-    if (json->stack[json->stack_top].type == JSON_ARRAY) {
-        if (json->stack[json->stack_top].count == 0) {
+    unsigned entry = stack_get(json, json->stack_top);
+    unsigned state = entry & STACK_STATE;
+    if (!(entry & STACK_OBJECT)) {
+        if (state == STACK_EMPTY) {
             if (c == ']') {
                 return pop(json, c, JSON_ARRAY);
             }
@@ -790,23 +1819,25 @@ enum json_type json_next(json_stream *json)
             }
             return JSON_ERROR;
         }
-    } else if (json->stack[json->stack_top].type == JSON_OBJECT) {
-        if (json->stack[json->stack_top].count == 0) {
+    } else {
+        if (state == STACK_EMPTY) {
             if (c == '}') {
                 return pop(json, c, JSON_OBJECT);
             }
 
             /* No member name/value pairs yet. */
             enum json_type value = read_value(json, c);
-            if (value != JSON_STRING) {
+            if (value == JSON_STRING_PART) {
+                return value;
+            } else if (value != JSON_STRING) {
                 if (value != JSON_ERROR)
                     json_error(json, "%s", "expected member name or '}'");
                 return JSON_ERROR;
             } else {
-                json->stack[json->stack_top].count++;
+                stack_count(json, json->stack_top);
                 return value;
             }
-        } else if ((json->stack[json->stack_top].count % 2) == 0) {
+        } else if (state == STACK_EVEN) {
             /* Expecting comma followed by member name. */
             if (c != ',' && c != '}') {
                 json_error(json, "%s", "expected ',' or '}' after member value");
@@ -815,16 +1846,18 @@ enum json_type json_next(json_stream *json)
                 return pop(json, c, JSON_OBJECT);
             } else {
                 enum json_type value = read_value(json, next(json));
-                if (value != JSON_STRING) {
+                if (value == JSON_STRING_PART) {
+                    return value;
+                } else if (value != JSON_STRING) {
                     if (value != JSON_ERROR)
                         json_error(json, "%s", "expected member name");
                     return JSON_ERROR;
                 } else {
-                    json->stack[json->stack_top].count++;
+                    stack_count(json, json->stack_top);
                     return value;
                 }
             }
-        } else if ((json->stack[json->stack_top].count % 2) == 1) {
+        } else if (state == STACK_ODD) {
             /* Expecting colon followed by value. */
             if (c != ':') {
                 json_error(json, "%s", "expected ':' after member name");
@@ -838,39 +1871,275 @@ enum json_type json_next(json_stream *json)
     return JSON_ERROR;
 }
 
+/* In push mode data that has been fed but not yet parsed sits in the
+   block buffer, and running out of it is not the end of the input. */
+static int feed_get(struct json_source *source)
+{
+    json_stream *json = source_owner(source);
+    if (!(json->flags & JSON_FLAG_FEED_END))
+        json->flags |= JSON_FLAG_STARVED;
+    return EOF;
+}
+
+/* Whether the data fed since the last event ran out could finish it.
+   Anything new might, except that a string can only be finished by a
+   quote, or by enough of it to make a part. */
+static int
+feed_ready(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    const unsigned char *p = source->cursor;
+    size_t have = source->limit - source->cursor;
+    size_t wait = source->source.feed.wait;
+
+    if (wait == (size_t)-1)
+        return 1;
+    if (have == wait)
+        return 0;
+    while (p < source->limit && (json_isspace(*p) || *p == ',' || *p == ':'))
+        p++;
+    if (((p < source->limit && *p == '"') || (json->flags & JSON_FLAG_PART)) &&
+        (json->data.part_size == 0 || have < json->data.part_size) &&
+        memchr(source->cursor + wait, '"', have - wait) == NULL) {
+        source->source.feed.wait = have;
+        return 0;
+    }
+    return 1;
+}
+
+/* Each event in push mode starts from a snapshot of the parser. Should
+   the data run out before the event is complete, the parser goes back
+   to the snapshot, and the event is read again from its start once more
+   data has been fed. Only the top of the stack can change in between. */
+static enum json_type
+feed_next(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    const unsigned char *cursor = source->cursor;
+    const unsigned char *counted = source->counted;
+    const unsigned char *mark = source->mark;
+    size_t lineno = json->lineno;
+    size_t ntokens = json->ntokens;
+    size_t top = json->stack_top;
+    unsigned flags = json->flags & ~JSON_FLAG_STARVED;
+    unsigned entry = 0;
+    size_t count = 0;
+    enum json_type type;
+
+    if (json->next != 0 || (flags & JSON_FLAG_ERROR))
+        return next_event(json);
+    if (!(flags & JSON_FLAG_FEED_END) && !feed_ready(json))
+        return JSON_INCOMPLETE;
+
+    if (top != (size_t)-1) {
+        entry = stack_get(json, top);
+        if (flags & JSON_FLAG_COUNTS)
+            count = json->counts[top];
+    }
+    json->flags = flags;
+    type = next_event(json);
+    if (!(json->flags & JSON_FLAG_STARVED)) {
+        source->source.feed.wait = (size_t)-1;
+        return type;
+    }
+
+    source->cursor = cursor;
+    source->counted = counted;
+    source->mark = mark;
+    source->source.feed.wait = source->limit - cursor;
+    json->lineno = lineno;
+    json->ntokens = ntokens;
+    json->stack_top = top;
+    if (top != (size_t)-1) {
+        stack_set(json, top, entry);
+        if (flags & JSON_FLAG_COUNTS)
+            json->counts[top] = count;
+    }
+    json->flags = flags;
+    json->errmsg[0] = '\0';
+    return JSON_INCOMPLETE;
+}
+
+enum json_type json_next(json_stream *json)
+{
+    /* Reading on drops whatever skip was left off */
+    json->flags &= ~JSON_FLAG_SKIP;
+    if (json->flags & JSON_FLAG_FEED)
+        return feed_next(json);
+    return next_event(json);
+}
+
 void json_reset(json_stream *json)
 {
     json->stack_top = -1;
     json->ntokens = 0;
-    json->flags &= ~JSON_FLAG_ERROR;
+    json->flags &= ~(JSON_FLAG_ERROR | JSON_FLAG_PART | JSON_FLAG_SKIP);
     json->errmsg[0] = '\0';
 }
 
-enum json_type json_skip(json_stream *json)
+/* The raw skip, for json_set_raw_skip(). Skips the rest of the container
+   just opened, heeding only brackets and strings (so that brackets in
+   strings are not counted), and returns the byte that closes it, or EOF.
+   An indexed buffer is walked by its index instead. Otherwise the window
+   is taken 64 bytes at a time as bitmaps, as for the index, and only
+   where there are enough closing brackets to end the container are they
+   looked at one by one. The state is carried a byte at a time across the
+   ends of windows, and for sources without one.
+ */
+static int
+raw_skip(json_stream *json)
 {
-    enum json_type type = json_next(json);
-    size_t cnt_arr = 0;
-    size_t cnt_obj = 0;
+    struct json_source *source = &json->source;
+    size_t depth = 1;
+    int string = 0;   /* 1 within a string, 2 just after a backslash */
 
-    for (enum json_type skip = type; ; skip = json_next(json)) {
-        if (skip == JSON_ERROR || skip == JSON_DONE)
-            return skip;
+    if (source->index != NULL) {
+        size_t size = source->limit - source->base;
+        size_t at = source->cursor - source->base;
+        while (source->index[source->index_next] < at)
+            source->index_next++;
+        for (;; source->index_next++) {
+            size_t i = source->index[source->index_next];
+            int c = i < size ? source->base[i] : EOF;
+            if (c == EOF || ((c == ']' || c == '}') && --depth == 0)) {
+                source->cursor = i < size ? source->base + i + 1 : source->limit;
+                source->mark = source->cursor;
+                return c;
+            }
+            if (c == '[' || c == '{')
+                depth++;
+        }
+    }
+
+    for (;;) {
+        unsigned char byte;
+        const unsigned char *start = source->cursor;
+        const unsigned char *end = source->limit;
+        const unsigned char *p = start;
+        int c = EOF;
 
-        if (skip == JSON_ARRAY) {
-            ++cnt_arr;
-        } else if (skip == JSON_ARRAY_END && cnt_arr > 0) {
-            --cnt_arr;
-        } else if (skip == JSON_OBJECT) {
-            ++cnt_obj;
-        } else if (skip == JSON_OBJECT_END && cnt_obj > 0) {
-            --cnt_obj;
+        if (p == end) {
+            /* Refill the window, or else take a byte through the source */
+            if (source_peek(json) == EOF)
+                return EOF;
+            if (source->cursor != source->limit)
+                continue;
+            byte = (unsigned char)source_get(json);
+            start = p = &byte;
+            end = p + 1;
         }
 
-        if (!cnt_arr && !cnt_obj)
-            break;
+        while (p < end) {
+            if (end - p >= 64) {
+                struct index_masks m;
+                uint64_t escape = string == 2;
+                uint64_t quote, inside, open, close;
+
+                index_classify(p, &m);
+                quote = m.quote & ~index_escaped(m.backslash, &escape);
+                inside = prefix_xor(quote) ^ (0 - (uint64_t)(string != 0));
+                open = m.open & ~inside;
+                close = m.close & ~inside;
+                if (popcount64(close) >= depth) {
+                    uint64_t bits;
+                    for (bits = open | close; bits; bits &= bits - 1) {
+                        unsigned i = ctz64(bits);
+                        if (open >> i & 1) {
+                            depth++;
+                        } else if (--depth == 0) {
+                            p += i;
+                            break;
+                        }
+                    }
+                    if (depth == 0) {
+                        c = *p++;
+                        break;
+                    }
+                } else {
+                    depth += popcount64(open);
+                    depth -= popcount64(close);
+                }
+                string = inside >> 63 ? 1 + (int)escape : 0;
+                p += 64;
+                continue;
+            }
+
+            c = *p++;
+            if (string == 2) {
+                string = 1;
+            } else if (string) {
+                if (c == '\\')
+                    string = 2;
+                else if (c == '"')
+                    string = 0;
+            } else if (c == '"') {
+                string = 1;
+            } else if (c == '[' || c == '{') {
+                depth++;
+            } else if ((c == ']' || c == '}') && --depth == 0) {
+                break;
+            }
+        }
+
+        /* Newlines in the window are left to be counted lazily */
+        if (start == &byte) {
+            count_lines(json, start, end);
+        } else {
+            source->cursor = depth == 0 ? p : end;
+            source->mark = source->cursor;
+        }
+        if (depth == 0)
+            return c;
     }
+}
 
-    return type;
+enum json_type json_skip(json_stream *json)
+{
+    enum json_type type, skip;
+    size_t depth;
+
+    if (json->flags & JSON_FLAG_SKIP) {
+        /* Carry on where a skip ran out of fed input */
+        json->flags &= ~JSON_FLAG_SKIP;
+        type = json->skip_type;
+        depth = json->skip_depth;
+    } else {
+        type = json_next(json);
+        depth = json_get_depth(json);
+        if (type != JSON_ARRAY && type != JSON_OBJECT && type != JSON_STRING_PART)
+            return type;
+    }
+
+    if (type != JSON_STRING_PART &&
+        (json->flags & (JSON_FLAG_RAW_SKIP | JSON_FLAG_FEED)) == JSON_FLAG_RAW_SKIP) {
+        int c = raw_skip(json);
+        if (c == EOF) {
+            json_error(json, "%s", "unexpected end of text");
+            return JSON_ERROR;
+        }
+        if (pop(json, c, c == ']' ? JSON_ARRAY : JSON_OBJECT) == JSON_ERROR)
+            return JSON_ERROR;
+        return type;
+    }
+
+    /* Skipped values are checked as usual, but not kept. The rest of a
+       string in parts, kept back from then on, is one part. */
+    json->flags |= JSON_FLAG_DISCARD;
+    do {
+        skip = json_next(json);
+        if (skip == JSON_INCOMPLETE) {
+            json->flags |= JSON_FLAG_SKIP;
+            json->skip_type = type;
+            json->skip_depth = depth;
+        }
+        if (skip == JSON_ERROR || skip == JSON_DONE || skip == JSON_INCOMPLETE) {
+            json->flags &= ~JSON_FLAG_DISCARD;
+            return skip;
+        }
+    } while (type == JSON_STRING_PART ? skip == JSON_STRING_PART
+                                      : json_get_depth(json) >= depth);
+    json->flags &= ~JSON_FLAG_DISCARD;
+    return type == JSON_STRING_PART ? skip : type;
 }
 
 enum json_type json_skip_until(json_stream *json, enum json_type type)
@@ -878,7 +2147,7 @@ enum json_type json_skip_until(json_stream *json, enum json_type type)
     while (1) {
         enum json_type skip = json_skip(json);
 
-        if (skip == JSON_ERROR || skip == JSON_DONE)
+        if (skip == JSON_ERROR || skip == JSON_DONE || skip == JSON_INCOMPLETE)
             return skip;
 
         if (skip == type)
@@ -888,111 +2157,1750 @@ enum json_type json_skip_until(json_stream *json, enum json_type type)
     return type;
 }
 
-const char *json_get_string(json_stream *json, size_t *length)
+/* Compare a JSON pointer reference token, still escaped, with a member
+   name. */
+static int
+pointer_match(const char *token, size_t length, const char *name, size_t n)
 {
-    if (length != NULL)
-        *length = json->data.string_fill;
-    if (json->data.string == NULL)
-        return "";
-    else
-        return json->data.string;
+    const char *end = token + length;
+    while (token < end) {
+        char c = *token++;
+        if (c == '~')
+            c = *token++ == '0' ? '~' : '/';
+        if (n == 0 || *name != c)
+            return 0;
+        name++;
+        n--;
+    }
+    return n == 0;
 }
 
-double json_get_number(json_stream *json)
+/* The array index a reference token stands for, or SIZE_MAX for one that
+   cannot be in the array (including "-", the element after the last). */
+static size_t
+pointer_index(const char *token, size_t length)
 {
-    char *p = json->data.string;
-    return p == NULL ? 0 : strtod(p, NULL);
+    size_t i, index = 0;
+    if (length == 0 || (token[0] == '0' && length > 1))
+        return SIZE_MAX;
+    for (i = 0; i < length; i++) {
+        if (!is_digit(token[i]) || index > (SIZE_MAX - 1 - (token[i] - '0')) / 10)
+            return SIZE_MAX;
+        index = index * 10 + (token[i] - '0');
+    }
+    return index;
 }
 
-const char *json_get_error(json_stream *json)
+/* A JSON pointer is empty or a series of '/'-prefixed reference tokens,
+   in which '~' only appears as "~0" or "~1". */
+static int
+pointer_valid(const char *pointer)
 {
-    return json->flags & JSON_FLAG_ERROR ? json->errmsg : NULL;
+    const char *p;
+    for (p = pointer; *p != '\0'; p++)
+        if ((p == pointer && *p != '/') ||
+            (*p == '~' && p[1] != '0' && p[1] != '1'))
+            return 0;
+    return 1;
 }
 
-size_t json_get_lineno(json_stream *json)
+/* Searches keep their place in locals, so they cannot pick up again
+   after JSON_INCOMPLETE; fed input has to be complete before they start.
+ */
+static int
+feed_whole(json_stream *json, const char *name)
 {
-    return json->lineno;
+    if ((json->flags & (JSON_FLAG_FEED | JSON_FLAG_FEED_END)) != JSON_FLAG_FEED)
+        return 1;
+    json_error(json, "%s() needs the end of the input fed first", name);
+    return 0;
 }
 
-size_t json_get_position(json_stream *json)
+/* Skip what is left of every open container deeper than depth. */
+static enum json_type
+skip_out(json_stream *json, size_t depth)
 {
-    return json->source.position;
+    enum json_type type = JSON_DONE;
+    while (json_get_depth(json) > depth)
+        if ((type = json_skip(json)) == JSON_ERROR || type == JSON_DONE ||
+            type == JSON_INCOMPLETE)
+            break;
+    return type;
 }
 
-size_t json_get_depth(json_stream *json)
+enum json_type json_find(json_stream *json, const char *pointer)
 {
-    return json->stack_top + 1;
-}
+    size_t depth = json_get_depth(json);
+    const char *p;
+    enum json_type type;
+    int found = 1;
 
-/* Return the current parsing context, that is, JSON_OBJECT if we are inside
-   an object, JSON_ARRAY if we are inside an array, and JSON_DONE if we are
-   not yet/anymore in either.
+    if (!feed_whole(json, "json_find"))
+        return JSON_ERROR;
+    if (!pointer_valid(pointer)) {
+        json_error(json, "invalid JSON pointer '%s'", pointer);
+        return JSON_ERROR;
+    }
 
-   Additionally, for the first two cases, also return the number of parsing
-   events that have already been observed at this level with json_next/peek().
-   In particular, inside an object, an odd number would indicate that the just
-   observed JSON_STRING event is a member name.
-*/
-enum json_type json_get_context(json_stream *json, size_t *count)
-{
-    if (json->stack_top == (size_t)-1)
-        return JSON_DONE;
+    /* Descend a reference token at a time, skipping whatever comes
+       before the member or element it names. */
+    type = json_next(json);
+    for (p = pointer; *p == '/' && type != JSON_ERROR; ) {
+        const char *token = ++p;
+        size_t length = strcspn(token, "/");
+        p += length;
+
+        if (type == JSON_OBJECT) {
+            while ((type = json_next(json)) == JSON_STRING) {
+                const char *name;
+                size_t n;
+                json_get_slice(json, &name, &n);
+                if (pointer_match(token, length, name, n)) {
+                    type = json_next(json);
+                    break;
+                }
+                if ((type = json_skip(json)) == JSON_ERROR)
+                    break;
+            }
+            if (type == JSON_OBJECT_END)
+                found = 0;
+        } else if (type == JSON_ARRAY) {
+            size_t i, index = pointer_index(token, length);
+            for (i = 0; i < index; i++)
+                if ((type = json_skip(json)) == JSON_ERROR || type == JSON_ARRAY_END)
+                    break;
+            if (i == index)
+                type = json_next(json);
+            if (type == JSON_ARRAY_END)
+                found = 0;
+        } else {
+            found = 0;
+        }
+        if (!found)
+            break;
+    }
 
-    if (count != NULL)
-        *count = json->stack[json->stack_top].count;
+    if (type == JSON_ERROR || found)
+        return type;
 
-    return json->stack[json->stack_top].type;
+    /* Not found, so finish off the value the search began with */
+    type = skip_out(json, depth);
+    return type == JSON_ERROR ? JSON_ERROR : JSON_DONE;
 }
 
-int json_source_get(json_stream *json)
+/* Extractor trie. Node 0 is the root, standing for the empty pointer;
+   the rest hang off it by first child and next sibling, in the order
+   their paths were given. Member names are stored unescaped. */
+struct extract_node {
+    size_t child;
+    size_t sibling;
+    const char *name;
+    size_t length;
+    size_t index;     /* array index the name spells, or SIZE_MAX */
+    size_t elements;  /* one past the highest child index, or 0 */
+    size_t path;      /* index of the path ending here, or SIZE_MAX */
+};
+
+struct json_extractor {
+    struct extract_node *nodes;
+    size_t nnodes;
+};
+
+json_extractor *json_extractor_compile(const char *const *paths, size_t n)
 {
-    int c = json->source.get(&json->source);
-    if (c == '\n')
-        json->lineno++;
-    return c;
+    json_extractor *ex;
+    size_t i, nnodes = 1, nchars = 0;
+    char *names;
+
+    for (i = 0; i < n; i++) {
+        const char *p;
+        if (!pointer_valid(paths[i]))
+            return NULL;
+        for (p = paths[i]; *p != '\0'; p++)
+            nnodes += *p == '/';
+        nchars += p - paths[i];
+    }
+
+    /* One allocation for the lot, so there is nothing to free per node */
+    ex = (json_extractor *)malloc(sizeof(*ex) + nnodes * sizeof(*ex->nodes) + nchars);
+    if (ex == NULL)
+        return NULL;
+    ex->nodes = (struct extract_node *)(ex + 1);
+    ex->nnodes = 1;
+    names = (char *)(ex->nodes + nnodes);
+    ex->nodes[0].child = 0;
+    ex->nodes[0].sibling = 0;
+    ex->nodes[0].name = names;
+    ex->nodes[0].length = 0;
+    ex->nodes[0].index = SIZE_MAX;
+    ex->nodes[0].elements = 0;
+    ex->nodes[0].path = SIZE_MAX;
+
+    for (i = 0; i < n; i++) {
+        const char *p = paths[i];
+        size_t node = 0;
+
+        while (*p == '/') {
+            const char *token = ++p;
+            size_t length = strcspn(token, "/");
+            size_t k, last = 0, index = pointer_index(token, length);
+            char *name = names;
+            struct extract_node *next;
+
+            for (p = token; p < token + length; p++)
+                *names++ = *p != '~' ? *p : *++p == '0' ? '~' : '/';
+
+            for (k = ex->nodes[node].child; k != 0; k = ex->nodes[k].sibling) {
+                last = k;
+                if (ex->nodes[k].length == (size_t)(names - name) &&
+                    !memcmp(ex->nodes[k].name, name, names - name))
+                    break;
+            }
+            if (k != 0) {
+                names = name;
+                node = k;
+                continue;
+            }
+
+            k = ex->nnodes++;
+            next = &ex->nodes[k];
+            next->child = 0;
+            next->sibling = 0;
+            next->name = name;
+            next->length = names - name;
+            next->index = index;
+            next->elements = 0;
+            next->path = SIZE_MAX;
+            if (last != 0)
+                ex->nodes[last].sibling = k;
+            else
+                ex->nodes[node].child = k;
+            if (index != SIZE_MAX && index >= ex->nodes[node].elements)
+                ex->nodes[node].elements = index + 1;
+            node = k;
+        }
+
+        if (ex->nodes[node].path == SIZE_MAX)
+            ex->nodes[node].path = i;
+    }
+    return ex;
 }
 
-int json_source_peek(json_stream *json)
+void json_extractor_free(json_extractor *ex)
 {
-    return json->source.peek(&json->source);
+    free(ex);
 }
 
-void json_open_buffer(json_stream *json, const void *buffer, size_t size)
+/* Walk the value whose first event, type, has just been read, reporting
+   matches at node and below it and skipping everything else. */
+static enum json_type
+extract_value(json_stream *json, const json_extractor *ex, const struct extract_node *node,
+              enum json_type type, json_extract_match match, void *user)
 {
-    init(json);
-    json->source.get = buffer_get;
-    json->source.peek = buffer_peek;
-    json->source.source.buffer.buffer = (const char *)buffer;
-    json->source.source.buffer.length = size;
+    size_t depth = json_get_depth(json);
+    const struct extract_node *c;
+
+    if (type != JSON_OBJECT && type != JSON_ARRAY) {
+        if (node->path != SIZE_MAX && type != JSON_ERROR)
+            match(json, node->path, type, user);
+        return type;
+    }
+
+    if (node->path != SIZE_MAX) {
+        size_t ntokens = json->ntokens;
+        match(json, node->path, type, user);
+        /* If the callback read into the value, it cannot be walked any
+           further, only finished off. */
+        if (json->ntokens != ntokens || json_get_depth(json) != depth)
+            return skip_out(json, depth - 1) == JSON_ERROR ? JSON_ERROR : type;
+    }
+
+    if (node->child == 0)
+        return skip_out(json, depth - 1) == JSON_ERROR ? JSON_ERROR : type;
+
+    if (type == JSON_OBJECT) {
+        enum json_type next;
+        while ((next = json_next(json)) == JSON_STRING) {
+            const char *name;
+            size_t n;
+            json_get_slice(json, &name, &n);
+            for (c = &ex->nodes[node->child]; ; c = &ex->nodes[c->sibling]) {
+                if (c->length == n && !memcmp(c->name, name, n)) {
+                    next = extract_value(json, ex, c, json_next(json), match, user);
+                    break;
+                }
+                if (c->sibling == 0) {
+                    next = json_skip(json);
+                    break;
+                }
+            }
+            if (next == JSON_ERROR)
+                return JSON_ERROR;
+        }
+        return next == JSON_ERROR ? JSON_ERROR : type;
+    }
+
+    /* Elements past the last index of interest are skipped wholesale */
+    {
+        size_t i;
+        for (i = 0; i < node->elements; i++) {
+            enum json_type next = json_peek(json);
+            if (next == JSON_ERROR)
+                return JSON_ERROR;
+            if (next == JSON_ARRAY_END) {
+                json_next(json);
+                return type;
+            }
+            for (c = &ex->nodes[node->child]; c->index != i; c = &ex->nodes[c->sibling])
+                if (c->sibling == 0)
+                    break;
+            if (c->index == i)
+                next = extract_value(json, ex, c, json_next(json), match, user);
+            else
+                next = json_skip(json);
+            if (next == JSON_ERROR)
+                return JSON_ERROR;
+        }
+    }
+    return skip_out(json, depth - 1) == JSON_ERROR ? JSON_ERROR : type;
 }
 
-void json_open_string(json_stream *json, const char *string)
+enum json_type json_extract(json_stream *json, const json_extractor *ex,
+                            json_extract_match match, void *user)
 {
-    json_open_buffer(json, string, strlen(string));
+    enum json_type type;
+    if (!feed_whole(json, "json_extract"))
+        return JSON_ERROR;
+    type = json_next(json);
+    if (type == JSON_ERROR || type == JSON_DONE ||
+        type == JSON_OBJECT_END || type == JSON_ARRAY_END)
+        return type;
+    return extract_value(json, ex, ex->nodes, type, match, user);
 }
 
-void json_open_stream(json_stream *json, FILE * stream)
+/* A 64-bit hash of a string, eight bytes at a time, finished off with
+   the MurmurHash3 mixer. It depends on the byte order, so it is only
+   good within one process. */
+static uint64_t
+string_hash(const char *p, size_t n)
 {
-    init(json);
-    json->source.get = stream_get;
-    json->source.peek = stream_peek;
-    json->source.source.stream.stream = stream;
+    uint64_t h = n * UINT64_C(0x9E3779B97F4A7C15);
+    uint64_t w;
+    for (; n >= 8; p += 8, n -= 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * UINT64_C(0xBF58476D1CE4E5B9);
+        h ^= h >> 31;
+    }
+    if (n > 0) {
+        w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * UINT64_C(0xBF58476D1CE4E5B9);
+    }
+    h ^= h >> 33;
+    h *= UINT64_C(0xFF51AFD7ED558CCD);
+    h ^= h >> 33;
+    h *= UINT64_C(0xC4CEB9FE1A85EC53);
+    h ^= h >> 33;
+    return h;
 }
 
-static int user_get(struct json_source *json)
+/* Key sets are perfect hash tables, built hash-and-displace style, with
+   at most twice as many slots as keys: keys fall into buckets by their
+   low hash bits, and each bucket gets the first seed that sends all its
+   keys to free slots, biggest buckets first. Looking up a key is then
+   one hash, two table reads and one comparison. */
+struct json_keyset {
+    size_t *slots;            /* key in each slot, or SIZE_MAX */
+    size_t *lengths;
+    const char **keys;
+    uint32_t *seeds;          /* per bucket */
+    size_t bucket_mask;
+    unsigned bits;            /* log2 of the slot count */
+};
+
+#define KEYSET_TRIES 65536
+
+static size_t
+keyset_slot(uint64_t hash, uint32_t seed, unsigned bits)
 {
-    int c = json->source.user.get(json->source.user.ptr);
-    if (c != EOF)
-        json->position++;
-    return c;
+    uint64_t x = hash ^ seed * UINT64_C(0x9E3779B97F4A7C15);
+    x ^= x >> 32;
+    x *= UINT64_C(0xD6E8FEB86659FD93);
+    return (size_t)(x >> (64 - bits));
 }
 
-static int user_peek(struct json_source *json)
+/* Place the keys of every bucket, biggest first, or fail. */
+static int
+keyset_place(json_keyset *ks, const uint64_t *hashes, const size_t *order,
+             const size_t *start, const size_t *count, size_t largest)
 {
-    return json->source.user.peek(json->source.user.ptr);
+    size_t nslots = (size_t)1 << ks->bits;
+    size_t i, b, size;
+
+    for (i = 0; i < nslots; i++)
+        ks->slots[i] = SIZE_MAX;
+    for (size = largest; size > 0; size--) {
+        for (b = 0; b <= ks->bucket_mask; b++) {
+            const size_t *keys = order + start[b];
+            uint32_t seed;
+            if (count[b] != size)
+                continue;
+            for (seed = 0; seed < KEYSET_TRIES; seed++) {
+                size_t j, k;
+                for (j = 0; j < size; j++) {
+                    size_t slot = keyset_slot(hashes[keys[j]], seed, ks->bits);
+                    if (ks->slots[slot] != SIZE_MAX)
+                        break;
+                    for (k = 0; k < j; k++)
+                        if (keyset_slot(hashes[keys[k]], seed, ks->bits) == slot)
+                            break;
+                    if (k < j)
+                        break;
+                }
+                if (j == size)
+                    break;
+            }
+            if (seed == KEYSET_TRIES)
+                return 0;
+            ks->seeds[b] = seed;
+            for (i = 0; i < size; i++)
+                ks->slots[keyset_slot(hashes[keys[i]], seed, ks->bits)] = keys[i];
+        }
+    }
+    return 1;
 }
 
-void json_open_user(json_stream *json, json_user_io get, json_user_io peek, void *user)
+json_keyset *json_keyset_compile(const char *const *keys, size_t n)
+{
+    json_keyset *ks = NULL;
+    size_t i, j, b, nbuckets = 1, nchars = 0, largest = 0;
+    unsigned bits = 1, attempt;
+    uint64_t *hashes = (uint64_t *)malloc((n + 1) * sizeof(*hashes));
+    size_t *order, *start, *count;
+
+    while (((size_t)1 << bits) < n)
+        bits++;
+    while (nbuckets * 2 < n)
+        nbuckets *= 2;
+    order = (size_t *)malloc((n + 2 * nbuckets + 1) * sizeof(*order));
+    if (hashes == NULL || order == NULL)
+        goto done;
+    start = order + n;
+    count = start + nbuckets + 1;
+
+    /* Counting sort into buckets, then drop repeated keys, which share a
+       bucket with the first of them */
+    for (b = 0; b <= nbuckets; b++)
+        start[b] = 0;
+    for (i = 0; i < n; i++) {
+        nchars += strlen(keys[i]) + 1;
+        hashes[i] = string_hash(keys[i], strlen(keys[i]));
+        start[(hashes[i] & (nbuckets - 1)) + 1]++;
+    }
+    for (b = 0; b < nbuckets; b++) {
+        start[b + 1] += start[b];
+        count[b] = 0;
+    }
+    for (i = 0; i < n; i++) {
+        b = hashes[i] & (nbuckets - 1);
+        for (j = 0; j < count[b]; j++) {
+            size_t k = order[start[b] + j];
+            if (hashes[k] == hashes[i] && !strcmp(keys[k], keys[i]))
+                break;
+        }
+        if (j == count[b])
+            order[start[b] + count[b]++] = i;
+        if (count[b] > largest)
+            largest = count[b];
+    }
+
+    /* Should the seeds run out, which takes very unlucky keys, try again
+       with more room */
+    for (attempt = 0; attempt < 4; attempt++, bits++) {
+        size_t nslots = (size_t)1 << bits;
+        char *text;
+        ks = (json_keyset *)malloc(sizeof(*ks) +
+                                   (nslots + n) * sizeof(*ks->slots) +
+                                   n * sizeof(*ks->keys) +
+                                   nbuckets * sizeof(*ks->seeds) + nchars);
+        if (ks == NULL)
+            goto done;
+        ks->slots = (size_t *)(ks + 1);
+        ks->lengths = ks->slots + nslots;
+        ks->keys = (const char **)(ks->lengths + n);
+        ks->seeds = (uint32_t *)(ks->keys + n);
+        ks->bucket_mask = nbuckets - 1;
+        ks->bits = bits;
+        if (keyset_place(ks, hashes, order, start, count, largest)) {
+            text = (char *)(ks->seeds + nbuckets);
+            for (i = 0; i < n; i++) {
+                ks->lengths[i] = strlen(keys[i]);
+                ks->keys[i] = text;
+                memcpy(text, keys[i], ks->lengths[i] + 1);
+                text += ks->lengths[i] + 1;
+            }
+            goto done;
+        }
+        free(ks);
+        ks = NULL;
+    }
+
+done:
+    free(hashes);
+    free(order);
+    return ks;
+}
+
+void json_keyset_free(json_keyset *ks)
+{
+    free(ks);
+}
+
+size_t json_keyset_lookup(const json_keyset *ks, json_stream *json)
+{
+    const char *p;
+    size_t n, key;
+    uint64_t hash;
+
+    json_get_slice(json, &p, &n);
+    hash = string_hash(p, n);
+    key = ks->slots[keyset_slot(hash, ks->seeds[hash & ks->bucket_mask], ks->bits)];
+    if (key != SIZE_MAX && ks->lengths[key] == n && !memcmp(ks->keys[key], p, n))
+        return key;
+    return SIZE_MAX;
+}
+
+/* Conversion of number text to double, independent of the locale and
+   correctly rounded. Short numbers are exact under Clinger's fast path.
+   Most of the rest are settled by the Eisel-Lemire algorithm, which
+   multiplies the decimal mantissa by a 128-bit approximation of the
+   power of ten and gives up only when the truncated product leaves the
+   rounding in doubt. Those rare cases fall back to exact decimal
+   arithmetic, shifting a big decimal by powers of two.
+ */
+
+/* Normalized 128-bit mantissas of 10^-342 through 10^324, rounded down,
+   high half first. Parsing needs no more than 10^308; the rest are for
+   writing the smallest subnormals. */
+static const uint64_t pow10_table[][2] = {
+    {0xEEF453D6923BD65A, 0x113FAA2906A13B3F}, {0x9558B4661B6565F8, 0x4AC7CA59A424C507},
+    {0xBAAEE17FA23EBF76, 0x5D79BCF00D2DF649}, {0xE95A99DF8ACE6F53, 0xF4D82C2C107973DC},
+    {0x91D8A02BB6C10594, 0x79071B9B8A4BE869}, {0xB64EC836A47146F9, 0x9748E2826CDEE284},
+    {0xE3E27A444D8D98B7, 0xFD1B1B2308169B25}, {0x8E6D8C6AB0787F72, 0xFE30F0F5E50E20F7},
+    {0xB208EF855C969F4F, 0xBDBD2D335E51A935}, {0xDE8B2B66B3BC4723, 0xAD2C788035E61382},
+    {0x8B16FB203055AC76, 0x4C3BCB5021AFCC31}, {0xADDCB9E83C6B1793, 0xDF4ABE242A1BBF3D},
+    {0xD953E8624B85DD78, 0xD71D6DAD34A2AF0D}, {0x87D4713D6F33AA6B, 0x8672648C40E5AD68},
+    {0xA9C98D8CCB009506, 0x680EFDAF511F18C2}, {0xD43BF0EFFDC0BA48, 0x0212BD1B2566DEF2},
+    {0x84A57695FE98746D, 0x014BB630F7604B57}, {0xA5CED43B7E3E9188, 0x419EA3BD35385E2D},
+    {0xCF42894A5DCE35EA, 0x52064CAC828675B9}, {0x818995CE7AA0E1B2, 0x7343EFEBD1940993},
+    {0xA1EBFB4219491A1F, 0x1014EBE6C5F90BF8}, {0xCA66FA129F9B60A6, 0xD41A26E077774EF6},
+    {0xFD00B897478238D0, 0x8920B098955522B4}, {0x9E20735E8CB16382, 0x55B46E5F5D5535B0},
+    {0xC5A890362FDDBC62, 0xEB2189F734AA831D}, {0xF712B443BBD52B7B, 0xA5E9EC7501D523E4},
+    {0x9A6BB0AA55653B2D, 0x47B233C92125366E}, {0xC1069CD4EABE89F8, 0x999EC0BB696E840A},
+    {0xF148440A256E2C76, 0xC00670EA43CA250D}, {0x96CD2A865764DBCA, 0x380406926A5E5728},
+    {0xBC807527ED3E12BC, 0xC605083704F5ECF2}, {0xEBA09271E88D976B, 0xF7864A44C633682E},
+    {0x93445B8731587EA3, 0x7AB3EE6AFBE0211D}, {0xB8157268FDAE9E4C, 0x5960EA05BAD82964},
+    {0xE61ACF033D1A45DF, 0x6FB92487298E33BD}, {0x8FD0C16206306BAB, 0xA5D3B6D479F8E056},
+    {0xB3C4F1BA87BC8696, 0x8F48A4899877186C}, {0xE0B62E2929ABA83C, 0x331ACDABFE94DE87},
+    {0x8C71DCD9BA0B4925, 0x9FF0C08B7F1D0B14}, {0xAF8E5410288E1B6F, 0x07ECF0AE5EE44DD9},
+    {0xDB71E91432B1A24A, 0xC9E82CD9F69D6150}, {0x892731AC9FAF056E, 0xBE311C083A225CD2},
+    {0xAB70FE17C79AC6CA, 0x6DBD630A48AAF406}, {0xD64D3D9DB981787D, 0x092CBBCCDAD5B108},
+    {0x85F0468293F0EB4E, 0x25BBF56008C58EA5}, {0xA76C582338ED2621, 0xAF2AF2B80AF6F24E},
+    {0xD1476E2C07286FAA, 0x1AF5AF660DB4AEE1}, {0x82CCA4DB847945CA, 0x50D98D9FC890ED4D},
+    {0xA37FCE126597973C, 0xE50FF107BAB528A0}, {0xCC5FC196FEFD7D0C, 0x1E53ED49A96272C8},
+    {0xFF77B1FCBEBCDC4F, 0x25E8E89C13BB0F7A}, {0x9FAACF3DF73609B1, 0x77B191618C54E9AC},
+    {0xC795830D75038C1D, 0xD59DF5B9EF6A2417}, {0xF97AE3D0D2446F25, 0x4B0573286B44AD1D},
+    {0x9BECCE62836AC577, 0x4EE367F9430AEC32}, {0xC2E801FB244576D5, 0x229C41F793CDA73F},
+    {0xF3A20279ED56D48A, 0x6B43527578C1110F}, {0x9845418C345644D6, 0x830A13896B78AAA9},
+    {0xBE5691EF416BD60C, 0x23CC986BC656D553}, {0xEDEC366B11C6CB8F, 0x2CBFBE86B7EC8AA8},
+    {0x94B3A202EB1C3F39, 0x7BF7D71432F3D6A9}, {0xB9E08A83A5E34F07, 0xDAF5CCD93FB0CC53},
+    {0xE858AD248F5C22C9, 0xD1B3400F8F9CFF68}, {0x91376C36D99995BE, 0x23100809B9C21FA1},
+    {0xB58547448FFFFB2D, 0xABD40A0C2832A78A}, {0xE2E69915B3FFF9F9, 0x16C90C8F323F516C},
+    {0x8DD01FAD907FFC3B, 0xAE3DA7D97F6792E3}, {0xB1442798F49FFB4A, 0x99CD11CFDF41779C},
+    {0xDD95317F31C7FA1D, 0x40405643D711D583}, {0x8A7D3EEF7F1CFC52, 0x482835EA666B2572},
+    {0xAD1C8EAB5EE43B66, 0xDA3243650005EECF}, {0xD863B256369D4A40, 0x90BED43E40076A82},
+    {0x873E4F75E2224E68, 0x5A7744A6E804A291}, {0xA90DE3535AAAE202, 0x711515D0A205CB36},
+    {0xD3515C2831559A83, 0x0D5A5B44CA873E03}, {0x8412D9991ED58091, 0xE858790AFE9486C2},
+    {0xA5178FFF668AE0B6, 0x626E974DBE39A872}, {0xCE5D73FF402D98E3, 0xFB0A3D212DC8128F},
+    {0x80FA687F881C7F8E, 0x7CE66634BC9D0B99}, {0xA139029F6A239F72, 0x1C1FFFC1EBC44E80},
+    {0xC987434744AC874E, 0xA327FFB266B56220}, {0xFBE9141915D7A922, 0x4BF1FF9F0062BAA8},
+    {0x9D71AC8FADA6C9B5, 0x6F773FC3603DB4A9}, {0xC4CE17B399107C22, 0xCB550FB4384D21D3},
+    {0xF6019DA07F549B2B, 0x7E2A53A146606A48}, {0x99C102844F94E0FB, 0x2EDA7444CBFC426D},
+    {0xC0314325637A1939, 0xFA911155FEFB5308}, {0xF03D93EEBC589F88, 0x793555AB7EBA27CA},
+    {0x96267C7535B763B5, 0x4BC1558B2F3458DE}, {0xBBB01B9283253CA2, 0x9EB1AAEDFB016F16},
+    {0xEA9C227723EE8BCB, 0x465E15A979C1CADC}, {0x92A1958A7675175F, 0x0BFACD89EC191EC9},
+    {0xB749FAED14125D36, 0xCEF980EC671F667B}, {0xE51C79A85916F484, 0x82B7E12780E7401A},
+    {0x8F31CC0937AE58D2, 0xD1B2ECB8B0908810}, {0xB2FE3F0B8599EF07, 0x861FA7E6DCB4AA15},
+    {0xDFBDCECE67006AC9, 0x67A791E093E1D49A}, {0x8BD6A141006042BD, 0xE0C8BB2C5C6D24E0},
+    {0xAECC49914078536D, 0x58FAE9F773886E18}, {0xDA7F5BF590966848, 0xAF39A475506A899E},
+    {0x888F99797A5E012D, 0x6D8406C952429603}, {0xAAB37FD7D8F58178, 0xC8E5087BA6D33B83},
+    {0xD5605FCDCF32E1D6, 0xFB1E4A9A90880A64}, {0x855C3BE0A17FCD26, 0x5CF2EEA09A55067F},
+    {0xA6B34AD8C9DFC06F, 0xF42FAA48C0EA481E}, {0xD0601D8EFC57B08B, 0xF13B94DAF124DA26},
+    {0x823C12795DB6CE57, 0x76C53D08D6B70858}, {0xA2CB1717B52481ED, 0x54768C4B0C64CA6E},
+    {0xCB7DDCDDA26DA268, 0xA9942F5DCF7DFD09}, {0xFE5D54150B090B02, 0xD3F93B35435D7C4C},
+    {0x9EFA548D26E5A6E1, 0xC47BC5014A1A6DAF}, {0xC6B8E9B0709F109A, 0x359AB6419CA1091B},
+    {0xF867241C8CC6D4C0, 0xC30163D203C94B62}, {0x9B407691D7FC44F8, 0x79E0DE63425DCF1D},
+    {0xC21094364DFB5636, 0x985915FC12F542E4}, {0xF294B943E17A2BC4, 0x3E6F5B7B17B2939D},
+    {0x979CF3CA6CEC5B5A, 0xA705992CEECF9C42}, {0xBD8430BD08277231, 0x50C6FF782A838353},
+    {0xECE53CEC4A314EBD, 0xA4F8BF5635246428}, {0x940F4613AE5ED136, 0x871B7795E136BE99},
+    {0xB913179899F68584, 0x28E2557B59846E3F}, {0xE757DD7EC07426E5, 0x331AEADA2FE589CF},
+    {0x9096EA6F3848984F, 0x3FF0D2C85DEF7621}, {0xB4BCA50B065ABE63, 0x0FED077A756B53A9},
+    {0xE1EBCE4DC7F16DFB, 0xD3E8495912C62894}, {0x8D3360F09CF6E4BD, 0x64712DD7ABBBD95C},
+    {0xB080392CC4349DEC, 0xBD8D794D96AACFB3}, {0xDCA04777F541C567, 0xECF0D7A0FC5583A0},
+    {0x89E42CAAF9491B60, 0xF41686C49DB57244}, {0xAC5D37D5B79B6239, 0x311C2875C522CED5},
+    {0xD77485CB25823AC7, 0x7D633293366B828B}, {0x86A8D39EF77164BC, 0xAE5DFF9C02033197},
+    {0xA8530886B54DBDEB, 0xD9F57F830283FDFC}, {0xD267CAA862A12D66, 0xD072DF63C324FD7B},
+    {0x8380DEA93DA4BC60, 0x4247CB9E59F71E6D}, {0xA46116538D0DEB78, 0x52D9BE85F074E608},
+    {0xCD795BE870516656, 0x67902E276C921F8B}, {0x806BD9714632DFF6, 0x00BA1CD8A3DB53B6},
+    {0xA086CFCD97BF97F3, 0x80E8A40ECCD228A4}, {0xC8A883C0FDAF7DF0, 0x6122CD128006B2CD},
+    {0xFAD2A4B13D1B5D6C, 0x796B805720085F81}, {0x9CC3A6EEC6311A63, 0xCBE3303674053BB0},
+    {0xC3F490AA77BD60FC, 0xBEDBFC4411068A9C}, {0xF4F1B4D515ACB93B, 0xEE92FB5515482D44},
+    {0x991711052D8BF3C5, 0x751BDD152D4D1C4A}, {0xBF5CD54678EEF0B6, 0xD262D45A78A0635D},
+    {0xEF340A98172AACE4, 0x86FB897116C87C34}, {0x9580869F0E7AAC0E, 0xD45D35E6AE3D4DA0},
+    {0xBAE0A846D2195712, 0x8974836059CCA109}, {0xE998D258869FACD7, 0x2BD1A438703FC94B},
+    {0x91FF83775423CC06, 0x7B6306A34627DDCF}, {0xB67F6455292CBF08, 0x1A3BC84C17B1D542},
+    {0xE41F3D6A7377EECA, 0x20CABA5F1D9E4A93}, {0x8E938662882AF53E, 0x547EB47B7282EE9C},
+    {0xB23867FB2A35B28D, 0xE99E619A4F23AA43}, {0xDEC681F9F4C31F31, 0x6405FA00E2EC94D4},
+    {0x8B3C113C38F9F37E, 0xDE83BC408DD3DD04}, {0xAE0B158B4738705E, 0x9624AB50B148D445},
+    {0xD98DDAEE19068C76, 0x3BADD624DD9B0957}, {0x87F8A8D4CFA417C9, 0xE54CA5D70A80E5D6},
+    {0xA9F6D30A038D1DBC, 0x5E9FCF4CCD211F4C}, {0xD47487CC8470652B, 0x7647C3200069671F},
+    {0x84C8D4DFD2C63F3B, 0x29ECD9F40041E073}, {0xA5FB0A17C777CF09, 0xF468107100525890},
+    {0xCF79CC9DB955C2CC, 0x7182148D4066EEB4}, {0x81AC1FE293D599BF, 0xC6F14CD848405530},
+    {0xA21727DB38CB002F, 0xB8ADA00E5A506A7C}, {0xCA9CF1D206FDC03B, 0xA6D90811F0E4851C},
+    {0xFD442E4688BD304A, 0x908F4A166D1DA663}, {0x9E4A9CEC15763E2E, 0x9A598E4E043287FE},
+    {0xC5DD44271AD3CDBA, 0x40EFF1E1853F29FD}, {0xF7549530E188C128, 0xD12BEE59E68EF47C},
+    {0x9A94DD3E8CF578B9, 0x82BB74F8301958CE}, {0xC13A148E3032D6E7, 0xE36A52363C1FAF01},
+    {0xF18899B1BC3F8CA1, 0xDC44E6C3CB279AC1}, {0x96F5600F15A7B7E5, 0x29AB103A5EF8C0B9},
+    {0xBCB2B812DB11A5DE, 0x7415D448F6B6F0E7}, {0xEBDF661791D60F56, 0x111B495B3464AD21},
+    {0x936B9FCEBB25C995, 0xCAB10DD900BEEC34}, {0xB84687C269EF3BFB, 0x3D5D514F40EEA742},
+    {0xE65829B3046B0AFA, 0x0CB4A5A3112A5112}, {0x8FF71A0FE2C2E6DC, 0x47F0E785EABA72AB},
+    {0xB3F4E093DB73A093, 0x59ED216765690F56}, {0xE0F218B8D25088B8, 0x306869C13EC3532C},
+    {0x8C974F7383725573, 0x1E414218C73A13FB}, {0xAFBD2350644EEACF, 0xE5D1929EF90898FA},
+    {0xDBAC6C247D62A583, 0xDF45F746B74ABF39}, {0x894BC396CE5DA772, 0x6B8BBA8C328EB783},
+    {0xAB9EB47C81F5114F, 0x066EA92F3F326564}, {0xD686619BA27255A2, 0xC80A537B0EFEFEBD},
+    {0x8613FD0145877585, 0xBD06742CE95F5F36}, {0xA798FC4196E952E7, 0x2C48113823B73704},
+    {0xD17F3B51FCA3A7A0, 0xF75A15862CA504C5}, {0x82EF85133DE648C4, 0x9A984D73DBE722FB},
+    {0xA3AB66580D5FDAF5, 0xC13E60D0D2E0EBBA}, {0xCC963FEE10B7D1B3, 0x318DF905079926A8},
+    {0xFFBBCFE994E5C61F, 0xFDF17746497F7052}, {0x9FD561F1FD0F9BD3, 0xFEB6EA8BEDEFA633},
+    {0xC7CABA6E7C5382C8, 0xFE64A52EE96B8FC0}, {0xF9BD690A1B68637B, 0x3DFDCE7AA3C673B0},
+    {0x9C1661A651213E2D, 0x06BEA10CA65C084E}, {0xC31BFA0FE5698DB8, 0x486E494FCFF30A62},
+    {0xF3E2F893DEC3F126, 0x5A89DBA3C3EFCCFA}, {0x986DDB5C6B3A76B7, 0xF89629465A75E01C},
+    {0xBE89523386091465, 0xF6BBB397F1135823}, {0xEE2BA6C0678B597F, 0x746AA07DED582E2C},
+    {0x94DB483840B717EF, 0xA8C2A44EB4571CDC}, {0xBA121A4650E4DDEB, 0x92F34D62616CE413},
+    {0xE896A0D7E51E1566, 0x77B020BAF9C81D17}, {0x915E2486EF32CD60, 0x0ACE1474DC1D122E},
+    {0xB5B5ADA8AAFF80B8, 0x0D819992132456BA}, {0xE3231912D5BF60E6, 0x10E1FFF697ED6C69},
+    {0x8DF5EFABC5979C8F, 0xCA8D3FFA1EF463C1}, {0xB1736B96B6FD83B3, 0xBD308FF8A6B17CB2},
+    {0xDDD0467C64BCE4A0, 0xAC7CB3F6D05DDBDE}, {0x8AA22C0DBEF60EE4, 0x6BCDF07A423AA96B},
+    {0xAD4AB7112EB3929D, 0x86C16C98D2C953C6}, {0xD89D64D57A607744, 0xE871C7BF077BA8B7},
+    {0x87625F056C7C4A8B, 0x11471CD764AD4972}, {0xA93AF6C6C79B5D2D, 0xD598E40D3DD89BCF},
+    {0xD389B47879823479, 0x4AFF1D108D4EC2C3}, {0x843610CB4BF160CB, 0xCEDF722A585139BA},
+    {0xA54394FE1EEDB8FE, 0xC2974EB4EE658828}, {0xCE947A3DA6A9273E, 0x733D226229FEEA32},
+    {0x811CCC668829B887, 0x0806357D5A3F525F}, {0xA163FF802A3426A8, 0xCA07C2DCB0CF26F7},
+    {0xC9BCFF6034C13052, 0xFC89B393DD02F0B5}, {0xFC2C3F3841F17C67, 0xBBAC2078D443ACE2},
+    {0x9D9BA7832936EDC0, 0xD54B944B84AA4C0D}, {0xC5029163F384A931, 0x0A9E795E65D4DF11},
+    {0xF64335BCF065D37D, 0x4D4617B5FF4A16D5}, {0x99EA0196163FA42E, 0x504BCED1BF8E4E45},
+    {0xC06481FB9BCF8D39, 0xE45EC2862F71E1D6}, {0xF07DA27A82C37088, 0x5D767327BB4E5A4C},
+    {0x964E858C91BA2655, 0x3A6A07F8D510F86F}, {0xBBE226EFB628AFEA, 0x890489F70A55368B},
+    {0xEADAB0ABA3B2DBE5, 0x2B45AC74CCEA842E}, {0x92C8AE6B464FC96F, 0x3B0B8BC90012929D},
+    {0xB77ADA0617E3BBCB, 0x09CE6EBB40173744}, {0xE55990879DDCAABD, 0xCC420A6A101D0515},
+    {0x8F57FA54C2A9EAB6, 0x9FA946824A12232D}, {0xB32DF8E9F3546564, 0x47939822DC96ABF9},
+    {0xDFF9772470297EBD, 0x59787E2B93BC56F7}, {0x8BFBEA76C619EF36, 0x57EB4EDB3C55B65A},
+    {0xAEFAE51477A06B03, 0xEDE622920B6B23F1}, {0xDAB99E59958885C4, 0xE95FAB368E45ECED},
+    {0x88B402F7FD75539B, 0x11DBCB0218EBB414}, {0xAAE103B5FCD2A881, 0xD652BDC29F26A119},
+    {0xD59944A37C0752A2, 0x4BE76D3346F0495F}, {0x857FCAE62D8493A5, 0x6F70A4400C562DDB},
+    {0xA6DFBD9FB8E5B88E, 0xCB4CCD500F6BB952}, {0xD097AD07A71F26B2, 0x7E2000A41346A7A7},
+    {0x825ECC24C873782F, 0x8ED400668C0C28C8}, {0xA2F67F2DFA90563B, 0x728900802F0F32FA},
+    {0xCBB41EF979346BCA, 0x4F2B40A03AD2FFB9}, {0xFEA126B7D78186BC, 0xE2F610C84987BFA8},
+    {0x9F24B832E6B0F436, 0x0DD9CA7D2DF4D7C9}, {0xC6EDE63FA05D3143, 0x91503D1C79720DBB},
+    {0xF8A95FCF88747D94, 0x75A44C6397CE912A}, {0x9B69DBE1B548CE7C, 0xC986AFBE3EE11ABA},
+    {0xC24452DA229B021B, 0xFBE85BADCE996168}, {0xF2D56790AB41C2A2, 0xFAE27299423FB9C3},
+    {0x97C560BA6B0919A5, 0xDCCD879FC967D41A}, {0xBDB6B8E905CB600F, 0x5400E987BBC1C920},
+    {0xED246723473E3813, 0x290123E9AAB23B68}, {0x9436C0760C86E30B, 0xF9A0B6720AAF6521},
+    {0xB94470938FA89BCE, 0xF808E40E8D5B3E69}, {0xE7958CB87392C2C2, 0xB60B1D1230B20E04},
+    {0x90BD77F3483BB9B9, 0xB1C6F22B5E6F48C2}, {0xB4ECD5F01A4AA828, 0x1E38AEB6360B1AF3},
+    {0xE2280B6C20DD5232, 0x25C6DA63C38DE1B0}, {0x8D590723948A535F, 0x579C487E5A38AD0E},
+    {0xB0AF48EC79ACE837, 0x2D835A9DF0C6D851}, {0xDCDB1B2798182244, 0xF8E431456CF88E65},
+    {0x8A08F0F8BF0F156B, 0x1B8E9ECB641B58FF}, {0xAC8B2D36EED2DAC5, 0xE272467E3D222F3F},
+    {0xD7ADF884AA879177, 0x5B0ED81DCC6ABB0F}, {0x86CCBB52EA94BAEA, 0x98E947129FC2B4E9},
+    {0xA87FEA27A539E9A5, 0x3F2398D747B36224}, {0xD29FE4B18E88640E, 0x8EEC7F0D19A03AAD},
+    {0x83A3EEEEF9153E89, 0x1953CF68300424AC}, {0xA48CEAAAB75A8E2B, 0x5FA8C3423C052DD7},
+    {0xCDB02555653131B6, 0x3792F412CB06794D}, {0x808E17555F3EBF11, 0xE2BBD88BBEE40BD0},
+    {0xA0B19D2AB70E6ED6, 0x5B6ACEAEAE9D0EC4}, {0xC8DE047564D20A8B, 0xF245825A5A445275},
+    {0xFB158592BE068D2E, 0xEED6E2F0F0D56712}, {0x9CED737BB6C4183D, 0x55464DD69685606B},
+    {0xC428D05AA4751E4C, 0xAA97E14C3C26B886}, {0xF53304714D9265DF, 0xD53DD99F4B3066A8},
+    {0x993FE2C6D07B7FAB, 0xE546A8038EFE4029}, {0xBF8FDB78849A5F96, 0xDE98520472BDD033},
+    {0xEF73D256A5C0F77C, 0x963E66858F6D4440}, {0x95A8637627989AAD, 0xDDE7001379A44AA8},
+    {0xBB127C53B17EC159, 0x5560C018580D5D52}, {0xE9D71B689DDE71AF, 0xAAB8F01E6E10B4A6},
+    {0x9226712162AB070D, 0xCAB3961304CA70E8}, {0xB6B00D69BB55C8D1, 0x3D607B97C5FD0D22},
+    {0xE45C10C42A2B3B05, 0x8CB89A7DB77C506A}, {0x8EB98A7A9A5B04E3, 0x77F3608E92ADB242},
+    {0xB267ED1940F1C61C, 0x55F038B237591ED3}, {0xDF01E85F912E37A3, 0x6B6C46DEC52F6688},
+    {0x8B61313BBABCE2C6, 0x2323AC4B3B3DA015}, {0xAE397D8AA96C1B77, 0xABEC975E0A0D081A},
+    {0xD9C7DCED53C72255, 0x96E7BD358C904A21}, {0x881CEA14545C7575, 0x7E50D64177DA2E54},
+    {0xAA242499697392D2, 0xDDE50BD1D5D0B9E9}, {0xD4AD2DBFC3D07787, 0x955E4EC64B44E864},
+    {0x84EC3C97DA624AB4, 0xBD5AF13BEF0B113E}, {0xA6274BBDD0FADD61, 0xECB1AD8AEACDD58E},
+    {0xCFB11EAD453994BA, 0x67DE18EDA5814AF2}, {0x81CEB32C4B43FCF4, 0x80EACF948770CED7},
+    {0xA2425FF75E14FC31, 0xA1258379A94D028D}, {0xCAD2F7F5359A3B3E, 0x096EE45813A04330},
+    {0xFD87B5F28300CA0D, 0x8BCA9D6E188853FC}, {0x9E74D1B791E07E48, 0x775EA264CF55347D},
+    {0xC612062576589DDA, 0x95364AFE032A819D}, {0xF79687AED3EEC551, 0x3A83DDBD83F52204},
+    {0x9ABE14CD44753B52, 0xC4926A9672793542}, {0xC16D9A0095928A27, 0x75B7053C0F178293},
+    {0xF1C90080BAF72CB1, 0x5324C68B12DD6338}, {0x971DA05074DA7BEE, 0xD3F6FC16EBCA5E03},
+    {0xBCE5086492111AEA, 0x88F4BB1CA6BCF584}, {0xEC1E4A7DB69561A5, 0x2B31E9E3D06C32E5},
+    {0x9392EE8E921D5D07, 0x3AFF322E62439FCF}, {0xB877AA3236A4B449, 0x09BEFEB9FAD487C2},
+    {0xE69594BEC44DE15B, 0x4C2EBE687989A9B3}, {0x901D7CF73AB0ACD9, 0x0F9D37014BF60A10},
+    {0xB424DC35095CD80F, 0x538484C19EF38C94}, {0xE12E13424BB40E13, 0x2865A5F206B06FB9},
+    {0x8CBCCC096F5088CB, 0xF93F87B7442E45D3}, {0xAFEBFF0BCB24AAFE, 0xF78F69A51539D748},
+    {0xDBE6FECEBDEDD5BE, 0xB573440E5A884D1B}, {0x89705F4136B4A597, 0x31680A88F8953030},
+    {0xABCC77118461CEFC, 0xFDC20D2B36BA7C3D}, {0xD6BF94D5E57A42BC, 0x3D32907604691B4C},
+    {0x8637BD05AF6C69B5, 0xA63F9A49C2C1B10F}, {0xA7C5AC471B478423, 0x0FCF80DC33721D53},
+    {0xD1B71758E219652B, 0xD3C36113404EA4A8}, {0x83126E978D4FDF3B, 0x645A1CAC083126E9},
+    {0xA3D70A3D70A3D70A, 0x3D70A3D70A3D70A3}, {0xCCCCCCCCCCCCCCCC, 0xCCCCCCCCCCCCCCCC},
+    {0x8000000000000000, 0x0000000000000000}, {0xA000000000000000, 0x0000000000000000},
+    {0xC800000000000000, 0x0000000000000000}, {0xFA00000000000000, 0x0000000000000000},
+    {0x9C40000000000000, 0x0000000000000000}, {0xC350000000000000, 0x0000000000000000},
+    {0xF424000000000000, 0x0000000000000000}, {0x9896800000000000, 0x0000000000000000},
+    {0xBEBC200000000000, 0x0000000000000000}, {0xEE6B280000000000, 0x0000000000000000},
+    {0x9502F90000000000, 0x0000000000000000}, {0xBA43B74000000000, 0x0000000000000000},
+    {0xE8D4A51000000000, 0x0000000000000000}, {0x9184E72A00000000, 0x0000000000000000},
+    {0xB5E620F480000000, 0x0000000000000000}, {0xE35FA931A0000000, 0x0000000000000000},
+    {0x8E1BC9BF04000000, 0x0000000000000000}, {0xB1A2BC2EC5000000, 0x0000000000000000},
+    {0xDE0B6B3A76400000, 0x0000000000000000}, {0x8AC7230489E80000, 0x0000000000000000},
+    {0xAD78EBC5AC620000, 0x0000000000000000}, {0xD8D726B7177A8000, 0x0000000000000000},
+    {0x878678326EAC9000, 0x0000000000000000}, {0xA968163F0A57B400, 0x0000000000000000},
+    {0xD3C21BCECCEDA100, 0x0000000000000000}, {0x84595161401484A0, 0x0000000000000000},
+    {0xA56FA5B99019A5C8, 0x0000000000000000}, {0xCECB8F27F4200F3A, 0x0000000000000000},
+    {0x813F3978F8940984, 0x4000000000000000}, {0xA18F07D736B90BE5, 0x5000000000000000},
+    {0xC9F2C9CD04674EDE, 0xA400000000000000}, {0xFC6F7C4045812296, 0x4D00000000000000},
+    {0x9DC5ADA82B70B59D, 0xF020000000000000}, {0xC5371912364CE305, 0x6C28000000000000},
+    {0xF684DF56C3E01BC6, 0xC732000000000000}, {0x9A130B963A6C115C, 0x3C7F400000000000},
+    {0xC097CE7BC90715B3, 0x4B9F100000000000}, {0xF0BDC21ABB48DB20, 0x1E86D40000000000},
+    {0x96769950B50D88F4, 0x1314448000000000}, {0xBC143FA4E250EB31, 0x17D955A000000000},
+    {0xEB194F8E1AE525FD, 0x5DCFAB0800000000}, {0x92EFD1B8D0CF37BE, 0x5AA1CAE500000000},
+    {0xB7ABC627050305AD, 0xF14A3D9E40000000}, {0xE596B7B0C643C719, 0x6D9CCD05D0000000},
+    {0x8F7E32CE7BEA5C6F, 0xE4820023A2000000}, {0xB35DBF821AE4F38B, 0xDDA2802C8A800000},
+    {0xE0352F62A19E306E, 0xD50B2037AD200000}, {0x8C213D9DA502DE45, 0x4526F422CC340000},
+    {0xAF298D050E4395D6, 0x9670B12B7F410000}, {0xDAF3F04651D47B4C, 0x3C0CDD765F114000},
+    {0x88D8762BF324CD0F, 0xA5880A69FB6AC800}, {0xAB0E93B6EFEE0053, 0x8EEA0D047A457A00},
+    {0xD5D238A4ABE98068, 0x72A4904598D6D880}, {0x85A36366EB71F041, 0x47A6DA2B7F864750},
+    {0xA70C3C40A64E6C51, 0x999090B65F67D924}, {0xD0CF4B50CFE20765, 0xFFF4B4E3F741CF6D},
+    {0x82818F1281ED449F, 0xBFF8F10E7A8921A4}, {0xA321F2D7226895C7, 0xAFF72D52192B6A0D},
+    {0xCBEA6F8CEB02BB39, 0x9BF4F8A69F764490}, {0xFEE50B7025C36A08, 0x02F236D04753D5B4},
+    {0x9F4F2726179A2245, 0x01D762422C946590}, {0xC722F0EF9D80AAD6, 0x424D3AD2B7B97EF5},
+    {0xF8EBAD2B84E0D58B, 0xD2E0898765A7DEB2}, {0x9B934C3B330C8577, 0x63CC55F49F88EB2F},
+    {0xC2781F49FFCFA6D5, 0x3CBF6B71C76B25FB}, {0xF316271C7FC3908A, 0x8BEF464E3945EF7A},
+    {0x97EDD871CFDA3A56, 0x97758BF0E3CBB5AC}, {0xBDE94E8E43D0C8EC, 0x3D52EEED1CBEA317},
+    {0xED63A231D4C4FB27, 0x4CA7AAA863EE4BDD}, {0x945E455F24FB1CF8, 0x8FE8CAA93E74EF6A},
+    {0xB975D6B6EE39E436, 0xB3E2FD538E122B44}, {0xE7D34C64A9C85D44, 0x60DBBCA87196B616},
+    {0x90E40FBEEA1D3A4A, 0xBC8955E946FE31CD}, {0xB51D13AEA4A488DD, 0x6BABAB6398BDBE41},
+    {0xE264589A4DCDAB14, 0xC696963C7EED2DD1}, {0x8D7EB76070A08AEC, 0xFC1E1DE5CF543CA2},
+    {0xB0DE65388CC8ADA8, 0x3B25A55F43294BCB}, {0xDD15FE86AFFAD912, 0x49EF0EB713F39EBE},
+    {0x8A2DBF142DFCC7AB, 0x6E3569326C784337}, {0xACB92ED9397BF996, 0x49C2C37F07965404},
+    {0xD7E77A8F87DAF7FB, 0xDC33745EC97BE906}, {0x86F0AC99B4E8DAFD, 0x69A028BB3DED71A3},
+    {0xA8ACD7C0222311BC, 0xC40832EA0D68CE0C}, {0xD2D80DB02AABD62B, 0xF50A3FA490C30190},
+    {0x83C7088E1AAB65DB, 0x792667C6DA79E0FA}, {0xA4B8CAB1A1563F52, 0x577001B891185938},
+    {0xCDE6FD5E09ABCF26, 0xED4C0226B55E6F86}, {0x80B05E5AC60B6178, 0x544F8158315B05B4},
+    {0xA0DC75F1778E39D6, 0x696361AE3DB1C721}, {0xC913936DD571C84C, 0x03BC3A19CD1E38E9},
+    {0xFB5878494ACE3A5F, 0x04AB48A04065C723}, {0x9D174B2DCEC0E47B, 0x62EB0D64283F9C76},
+    {0xC45D1DF942711D9A, 0x3BA5D0BD324F8394}, {0xF5746577930D6500, 0xCA8F44EC7EE36479},
+    {0x9968BF6ABBE85F20, 0x7E998B13CF4E1ECB}, {0xBFC2EF456AE276E8, 0x9E3FEDD8C321A67E},
+    {0xEFB3AB16C59B14A2, 0xC5CFE94EF3EA101E}, {0x95D04AEE3B80ECE5, 0xBBA1F1D158724A12},
+    {0xBB445DA9CA61281F, 0x2A8A6E45AE8EDC97}, {0xEA1575143CF97226, 0xF52D09D71A3293BD},
+    {0x924D692CA61BE758, 0x593C2626705F9C56}, {0xB6E0C377CFA2E12E, 0x6F8B2FB00C77836C},
+    {0xE498F455C38B997A, 0x0B6DFB9C0F956447}, {0x8EDF98B59A373FEC, 0x4724BD4189BD5EAC},
+    {0xB2977EE300C50FE7, 0x58EDEC91EC2CB657}, {0xDF3D5E9BC0F653E1, 0x2F2967B66737E3ED},
+    {0x8B865B215899F46C, 0xBD79E0D20082EE74}, {0xAE67F1E9AEC07187, 0xECD8590680A3AA11},
+    {0xDA01EE641A708DE9, 0xE80E6F4820CC9495}, {0x884134FE908658B2, 0x3109058D147FDCDD},
+    {0xAA51823E34A7EEDE, 0xBD4B46F0599FD415}, {0xD4E5E2CDC1D1EA96, 0x6C9E18AC7007C91A},
+    {0x850FADC09923329E, 0x03E2CF6BC604DDB0}, {0xA6539930BF6BFF45, 0x84DB8346B786151C},
+    {0xCFE87F7CEF46FF16, 0xE612641865679A63}, {0x81F14FAE158C5F6E, 0x4FCB7E8F3F60C07E},
+    {0xA26DA3999AEF7749, 0xE3BE5E330F38F09D}, {0xCB090C8001AB551C, 0x5CADF5BFD3072CC5},
+    {0xFDCB4FA002162A63, 0x73D9732FC7C8F7F6}, {0x9E9F11C4014DDA7E, 0x2867E7FDDCDD9AFA},
+    {0xC646D63501A1511D, 0xB281E1FD541501B8}, {0xF7D88BC24209A565, 0x1F225A7CA91A4226},
+    {0x9AE757596946075F, 0x3375788DE9B06958}, {0xC1A12D2FC3978937, 0x0052D6B1641C83AE},
+    {0xF209787BB47D6B84, 0xC0678C5DBD23A49A}, {0x9745EB4D50CE6332, 0xF840B7BA963646E0},
+    {0xBD176620A501FBFF, 0xB650E5A93BC3D898}, {0xEC5D3FA8CE427AFF, 0xA3E51F138AB4CEBE},
+    {0x93BA47C980E98CDF, 0xC66F336C36B10137}, {0xB8A8D9BBE123F017, 0xB80B0047445D4184},
+    {0xE6D3102AD96CEC1D, 0xA60DC059157491E5}, {0x9043EA1AC7E41392, 0x87C89837AD68DB2F},
+    {0xB454E4A179DD1877, 0x29BABE4598C311FB}, {0xE16A1DC9D8545E94, 0xF4296DD6FEF3D67A},
+    {0x8CE2529E2734BB1D, 0x1899E4A65F58660C}, {0xB01AE745B101E9E4, 0x5EC05DCFF72E7F8F},
+    {0xDC21A1171D42645D, 0x76707543F4FA1F73}, {0x899504AE72497EBA, 0x6A06494A791C53A8},
+    {0xABFA45DA0EDBDE69, 0x0487DB9D17636892}, {0xD6F8D7509292D603, 0x45A9D2845D3C42B6},
+    {0x865B86925B9BC5C2, 0x0B8A2392BA45A9B2}, {0xA7F26836F282B732, 0x8E6CAC7768D7141E},
+    {0xD1EF0244AF2364FF, 0x3207D795430CD926}, {0x8335616AED761F1F, 0x7F44E6BD49E807B8},
+    {0xA402B9C5A8D3A6E7, 0x5F16206C9C6209A6}, {0xCD036837130890A1, 0x36DBA887C37A8C0F},
+    {0x802221226BE55A64, 0xC2494954DA2C9789}, {0xA02AA96B06DEB0FD, 0xF2DB9BAA10B7BD6C},
+    {0xC83553C5C8965D3D, 0x6F92829494E5ACC7}, {0xFA42A8B73ABBF48C, 0xCB772339BA1F17F9},
+    {0x9C69A97284B578D7, 0xFF2A760414536EFB}, {0xC38413CF25E2D70D, 0xFEF5138519684ABA},
+    {0xF46518C2EF5B8CD1, 0x7EB258665FC25D69}, {0x98BF2F79D5993802, 0xEF2F773FFBD97A61},
+    {0xBEEEFB584AFF8603, 0xAAFB550FFACFD8FA}, {0xEEAABA2E5DBF6784, 0x95BA2A53F983CF38},
+    {0x952AB45CFA97A0B2, 0xDD945A747BF26183}, {0xBA756174393D88DF, 0x94F971119AEEF9E4},
+    {0xE912B9D1478CEB17, 0x7A37CD5601AAB85D}, {0x91ABB422CCB812EE, 0xAC62E055C10AB33A},
+    {0xB616A12B7FE617AA, 0x577B986B314D6009}, {0xE39C49765FDF9D94, 0xED5A7E85FDA0B80B},
+    {0x8E41ADE9FBEBC27D, 0x14588F13BE847307}, {0xB1D219647AE6B31C, 0x596EB2D8AE258FC8},
+    {0xDE469FBD99A05FE3, 0x6FCA5F8ED9AEF3BB}, {0x8AEC23D680043BEE, 0x25DE7BB9480D5854},
+    {0xADA72CCC20054AE9, 0xAF561AA79A10AE6A}, {0xD910F7FF28069DA4, 0x1B2BA1518094DA04},
+    {0x87AA9AFF79042286, 0x90FB44D2F05D0842}, {0xA99541BF57452B28, 0x353A1607AC744A53},
+    {0xD3FA922F2D1675F2, 0x42889B8997915CE8}, {0x847C9B5D7C2E09B7, 0x69956135FEBADA11},
+    {0xA59BC234DB398C25, 0x43FAB9837E699095}, {0xCF02B2C21207EF2E, 0x94F967E45E03F4BB},
+    {0x8161AFB94B44F57D, 0x1D1BE0EEBAC278F5}, {0xA1BA1BA79E1632DC, 0x6462D92A69731732},
+    {0xCA28A291859BBF93, 0x7D7B8F7503CFDCFE}, {0xFCB2CB35E702AF78, 0x5CDA735244C3D43E},
+    {0x9DEFBF01B061ADAB, 0x3A0888136AFA64A7}, {0xC56BAEC21C7A1916, 0x088AAA1845B8FDD0},
+    {0xF6C69A72A3989F5B, 0x8AAD549E57273D45}, {0x9A3C2087A63F6399, 0x36AC54E2F678864B},
+    {0xC0CB28A98FCF3C7F, 0x84576A1BB416A7DD}, {0xF0FDF2D3F3C30B9F, 0x656D44A2A11C51D5},
+    {0x969EB7C47859E743, 0x9F644AE5A4B1B325}, {0xBC4665B596706114, 0x873D5D9F0DDE1FEE},
+    {0xEB57FF22FC0C7959, 0xA90CB506D155A7EA}, {0x9316FF75DD87CBD8, 0x09A7F12442D588F2},
+    {0xB7DCBF5354E9BECE, 0x0C11ED6D538AEB2F}, {0xE5D3EF282A242E81, 0x8F1668C8A86DA5FA},
+    {0x8FA475791A569D10, 0xF96E017D694487BC}, {0xB38D92D760EC4455, 0x37C981DCC395A9AC},
+    {0xE070F78D3927556A, 0x85BBE253F47B1417}, {0x8C469AB843B89562, 0x93956D7478CCEC8E},
+    {0xAF58416654A6BABB, 0x387AC8D1970027B2}, {0xDB2E51BFE9D0696A, 0x06997B05FCC0319E},
+    {0x88FCF317F22241E2, 0x441FECE3BDF81F03}, {0xAB3C2FDDEEAAD25A, 0xD527E81CAD7626C3},
+    {0xD60B3BD56A5586F1, 0x8A71E223D8D3B074}, {0x85C7056562757456, 0xF6872D5667844E49},
+    {0xA738C6BEBB12D16C, 0xB428F8AC016561DB}, {0xD106F86E69D785C7, 0xE13336D701BEBA52},
+    {0x82A45B450226B39C, 0xECC0024661173473}, {0xA34D721642B06084, 0x27F002D7F95D0190},
+    {0xCC20CE9BD35C78A5, 0x31EC038DF7B441F4}, {0xFF290242C83396CE, 0x7E67047175A15271},
+    {0x9F79A169BD203E41, 0x0F0062C6E984D386}, {0xC75809C42C684DD1, 0x52C07B78A3E60868},
+    {0xF92E0C3537826145, 0xA7709A56CCDF8A82}, {0x9BBCC7A142B17CCB, 0x88A66076400BB691},
+    {0xC2ABF989935DDBFE, 0x6ACFF893D00EA435}, {0xF356F7EBF83552FE, 0x0583F6B8C4124D43},
+    {0x98165AF37B2153DE, 0xC3727A337A8B704A}, {0xBE1BF1B059E9A8D6, 0x744F18C0592E4C5C},
+    {0xEDA2EE1C7064130C, 0x1162DEF06F79DF73}, {0x9485D4D1C63E8BE7, 0x8ADDCB5645AC2BA8},
+    {0xB9A74A0637CE2EE1, 0x6D953E2BD7173692}, {0xE8111C87C5C1BA99, 0xC8FA8DB6CCDD0437},
+    {0x910AB1D4DB9914A0, 0x1D9C9892400A22A2}, {0xB54D5E4A127F59C8, 0x2503BEB6D00CAB4B},
+    {0xE2A0B5DC971F303A, 0x2E44AE64840FD61D}, {0x8DA471A9DE737E24, 0x5CEAECFED289E5D2},
+    {0xB10D8E1456105DAD, 0x7425A83E872C5F47}, {0xDD50F1996B947518, 0xD12F124E28F77719},
+    {0x8A5296FFE33CC92F, 0x82BD6B70D99AAA6F}, {0xACE73CBFDC0BFB7B, 0x636CC64D1001550B},
+    {0xD8210BEFD30EFA5A, 0x3C47F7E05401AA4E}, {0x8714A775E3E95C78, 0x65ACFAEC34810A71},
+    {0xA8D9D1535CE3B396, 0x7F1839A741A14D0D}, {0xD31045A8341CA07C, 0x1EDE48111209A050},
+    {0x83EA2B892091E44D, 0x934AED0AAB460432}, {0xA4E4B66B68B65D60, 0xF81DA84D5617853F},
+    {0xCE1DE40642E3F4B9, 0x36251260AB9D668E}, {0x80D2AE83E9CE78F3, 0xC1D72B7C6B426019},
+    {0xA1075A24E4421730, 0xB24CF65B8612F81F}, {0xC94930AE1D529CFC, 0xDEE033F26797B627},
+    {0xFB9B7CD9A4A7443C, 0x169840EF017DA3B1}, {0x9D412E0806E88AA5, 0x8E1F289560EE864E},
+    {0xC491798A08A2AD4E, 0xF1A6F2BAB92A27E2}, {0xF5B5D7EC8ACB58A2, 0xAE10AF696774B1DB},
+    {0x9991A6F3D6BF1765, 0xACCA6DA1E0A8EF29}, {0xBFF610B0CC6EDD3F, 0x17FD090A58D32AF3},
+    {0xEFF394DCFF8A948E, 0xDDFC4B4CEF07F5B0}, {0x95F83D0A1FB69CD9, 0x4ABDAF101564F98E},
+    {0xBB764C4CA7A4440F, 0x9D6D1AD41ABE37F1}, {0xEA53DF5FD18D5513, 0x84C86189216DC5ED},
+    {0x92746B9BE2F8552C, 0x32FD3CF5B4E49BB4}, {0xB7118682DBB66A77, 0x3FBC8C33221DC2A1},
+    {0xE4D5E82392A40515, 0x0FABAF3FEAA5334A}, {0x8F05B1163BA6832D, 0x29CB4D87F2A7400E},
+    {0xB2C71D5BCA9023F8, 0x743E20E9EF511012}, {0xDF78E4B2BD342CF6, 0x914DA9246B255416},
+    {0x8BAB8EEFB6409C1A, 0x1AD089B6C2F7548E}, {0xAE9672ABA3D0C320, 0xA184AC2473B529B1},
+    {0xDA3C0F568CC4F3E8, 0xC9E5D72D90A2741E}, {0x8865899617FB1871, 0x7E2FA67C7A658892},
+    {0xAA7EEBFB9DF9DE8D, 0xDDBB901B98FEEAB7}, {0xD51EA6FA85785631, 0x552A74227F3EA565},
+    {0x8533285C936B35DE, 0xD53A88958F87275F}, {0xA67FF273B8460356, 0x8A892ABAF368F137},
+    {0xD01FEF10A657842C, 0x2D2B7569B0432D85}, {0x8213F56A67F6B29B, 0x9C3B29620E29FC73},
+    {0xA298F2C501F45F42, 0x8349F3BA91B47B8F}, {0xCB3F2F7642717713, 0x241C70A936219A73},
+    {0xFE0EFB53D30DD4D7, 0xED238CD383AA0110}, {0x9EC95D1463E8A506, 0xF4363804324A40AA},
+    {0xC67BB4597CE2CE48, 0xB143C6053EDCD0D5}, {0xF81AA16FDC1B81DA, 0xDD94B7868E94050A},
+    {0x9B10A4E5E9913128, 0xCA7CF2B4191C8326}, {0xC1D4CE1F63F57D72, 0xFD1C2F611F63A3F0},
+    {0xF24A01A73CF2DCCF, 0xBC633B39673C8CEC}, {0x976E41088617CA01, 0xD5BE0503E085D813},
+    {0xBD49D14AA79DBC82, 0x4B2D8644D8A74E18}, {0xEC9C459D51852BA2, 0xDDF8E7D60ED1219E},
+    {0x93E1AB8252F33B45, 0xCABB90E5C942B503}, {0xB8DA1662E7B00A17, 0x3D6A751F3B936243},
+    {0xE7109BFBA19C0C9D, 0x0CC512670A783AD4}, {0x906A617D450187E2, 0x27FB2B80668B24C5},
+    {0xB484F9DC9641E9DA, 0xB1F9F660802DEDF6}, {0xE1A63853BBD26451, 0x5E7873F8A0396973},
+    {0x8D07E33455637EB2, 0xDB0B487B6423E1E8}, {0xB049DC016ABC5E5F, 0x91CE1A9A3D2CDA62},
+    {0xDC5C5301C56B75F7, 0x7641A140CC7810FB}, {0x89B9B3E11B6329BA, 0xA9E904C87FCB0A9D},
+    {0xAC2820D9623BF429, 0x546345FA9FBDCD44}, {0xD732290FBACAF133, 0xA97C177947AD4095},
+    {0x867F59A9D4BED6C0, 0x49ED8EABCCCC485D}, {0xA81F301449EE8C70, 0x5C68F256BFFF5A74},
+    {0xD226FC195C6A2F8C, 0x73832EEC6FFF3111}, {0x83585D8FD9C25DB7, 0xC831FD53C5FF7EAB},
+    {0xA42E74F3D032F525, 0xBA3E7CA8B77F5E55}, {0xCD3A1230C43FB26F, 0x28CE1BD2E55F35EB},
+    {0x80444B5E7AA7CF85, 0x7980D163CF5B81B3}, {0xA0555E361951C366, 0xD7E105BCC332621F},
+    {0xC86AB5C39FA63440, 0x8DD9472BF3FEFAA7}, {0xFA856334878FC150, 0xB14F98F6F0FEB951},
+    {0x9C935E00D4B9D8D2, 0x6ED1BF9A569F33D3}, {0xC3B8358109E84F07, 0x0A862F80EC4700C8},
+    {0xF4A642E14C6262C8, 0xCD27BB612758C0FA}, {0x98E7E9CCCFBD7DBD, 0x8038D51CB897789C},
+    {0xBF21E44003ACDD2C, 0xE0470A63E6BD56C3}, {0xEEEA5D5004981478, 0x1858CCFCE06CAC74},
+    {0x95527A5202DF0CCB, 0x0F37801E0C43EBC8}, {0xBAA718E68396CFFD, 0xD30560258F54E6BA},
+    {0xE950DF20247C83FD, 0x47C6B82EF32A2069}, {0x91D28B7416CDD27E, 0x4CDC331D57FA5441},
+    {0xB6472E511C81471D, 0xE0133FE4ADF8E952}, {0xE3D8F9E563A198E5, 0x58180FDDD97723A6},
+    {0x8E679C2F5E44FF8F, 0x570F09EAA7EA7648}, {0xB201833B35D63F73, 0x2CD2CC6551E513DA},
+    {0xDE81E40A034BCF4F, 0xF8077F7EA65E58D1}, {0x8B112E86420F6191, 0xFB04AFAF27FAF782},
+    {0xADD57A27D29339F6, 0x79C5DB9AF1F9B563}, {0xD94AD8B1C7380874, 0x18375281AE7822BC},
+    {0x87CEC76F1C830548, 0x8F2293910D0B15B5}, {0xA9C2794AE3A3C69A, 0xB2EB3875504DDB22},
+    {0xD433179D9C8CB841, 0x5FA60692A46151EB}, {0x849FEEC281D7F328, 0xDBC7C41BA6BCD333},
+    {0xA5C7EA73224DEFF3, 0x12B9B522906C0800}, {0xCF39E50FEAE16BEF, 0xD768226B34870A00},
+    {0x81842F29F2CCE375, 0xE6A1158300D46640}, {0xA1E53AF46F801C53, 0x60495AE3C1097FD0},
+    {0xCA5E89B18B602368, 0x385BB19CB14BDFC4}, {0xFCF62C1DEE382C42, 0x46729E03DD9ED7B5},
+    {0x9E19DB92B4E31BA9, 0x6C07A2C26A8346D1},
+};
+
+#define POW10_MIN (-342)
+#define POW10_MAX 308
+
+static int
+clz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    for (; !(x >> 63); x <<= 1)
+        n++;
+    return n;
+#endif
+}
+
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 uint128;
+#endif
+
+/* Full 64x64 -> 128-bit product. */
+static uint64_t
+mul128(uint64_t a, uint64_t b, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+    uint128 r = (uint128)a * b;
+    *lo = (uint64_t)r;
+    return (uint64_t)(r >> 64);
+#else
+    uint64_t a0 = a & 0xffffffff, a1 = a >> 32;
+    uint64_t b0 = b & 0xffffffff, b1 = b >> 32;
+    uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    uint64_t mid = (p00 >> 32) + (p01 & 0xffffffff) + (p10 & 0xffffffff);
+    *lo = (mid << 32) | (p00 & 0xffffffff);
+    return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+static double
+bits_double(uint64_t bits)
+{
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/* Returns zero when w * 10^e10 cannot be rounded with certainty, or
+   would be subnormal or infinite. Requires w != 0. */
+static int
+eisel_lemire(uint64_t w, int e10, int neg, double *result)
+{
+    uint64_t hi, lo, mant, bits;
+    long e2;
+    int shift, msb;
+    const uint64_t *pow10;
+
+    if (e10 < POW10_MIN || e10 > POW10_MAX)
+        return 0;
+    pow10 = pow10_table[e10 - POW10_MIN];
+
+    shift = clz64(w);
+    w <<= shift;
+    /* floor(log2(10^e10)), computed without shifting negative values */
+    e2 = 217706L * e10;
+    e2 = (e2 >= 0 ? e2 / 65536 : -((-e2 + 65535) / 65536)) + 64 + 1023 - shift;
+
+    hi = mul128(w, pow10[0], &lo);
+    if ((hi & 0x1ff) == 0x1ff && lo + w < w) {
+        /* Widen the approximation with the low half of the power. */
+        uint64_t yhi, ylo, mhi = hi, mlo;
+        yhi = mul128(w, pow10[1], &ylo);
+        mlo = lo + yhi;
+        if (mlo < lo)
+            mhi++;
+        if ((mhi & 0x1ff) == 0x1ff && mlo + 1 == 0 && ylo + w < w)
+            return 0;
+        hi = mhi;
+        lo = mlo;
+    }
+
+    msb = (int)(hi >> 63);
+    mant = hi >> (msb + 9);
+    e2 -= 1 ^ msb;
+
+    /* Halfway between two doubles, which the truncation cannot tell. */
+    if (lo == 0 && (hi & 0x1ff) == 0 && (mant & 3) == 1)
+        return 0;
+
+    mant += mant & 1;
+    mant >>= 1;
+    if (mant >> 53) {
+        mant >>= 1;
+        e2++;
+    }
+    if (e2 <= 0 || e2 >= 0x7ff)
+        return 0;
+
+    bits = (uint64_t)e2 << 52 | (mant & 0x000fffffffffffff);
+    if (neg)
+        bits |= 0x8000000000000000;
+    *result = bits_double(bits);
+    return 1;
+}
+
+/* An arbitrary precision decimal, 0.d[0]d[1]... * 10^dp, digits stored
+   as values rather than characters. Digits past the end of d[] are
+   dropped, with trunc noting whether any of them were non-zero. */
+#define DECIMAL_DIGITS 800
+#define DECIMAL_SHIFT  60
+
+struct decimal {
+    unsigned char d[DECIMAL_DIGITS];
+    int nd;
+    int dp;
+    int trunc;
+};
+
+static void
+decimal_trim(struct decimal *a)
+{
+    while (a->nd > 0 && a->d[a->nd - 1] == 0)
+        a->nd--;
+    if (a->nd == 0)
+        a->dp = 0;
+}
+
+/* Multiply by 2^k, for k <= DECIMAL_SHIFT. */
+static void
+decimal_left_shift(struct decimal *a, unsigned k)
+{
+    unsigned char tmp[DECIMAL_DIGITS + 20];
+    int w = sizeof(tmp);
+    int n;
+    uint64_t acc = 0;
+
+    for (int r = a->nd - 1; r >= 0; r--) {
+        acc += (uint64_t)a->d[r] << k;
+        tmp[--w] = acc % 10;
+        acc /= 10;
+    }
+    for (; acc > 0; acc /= 10)
+        tmp[--w] = acc % 10;
+
+    n = (int)sizeof(tmp) - w;
+    a->dp += n - a->nd;
+    if (n > DECIMAL_DIGITS) {
+        for (int i = w + DECIMAL_DIGITS; i < (int)sizeof(tmp); i++)
+            if (tmp[i])
+                a->trunc = 1;
+        n = DECIMAL_DIGITS;
+    }
+    memcpy(a->d, tmp + w, n);
+    a->nd = n;
+    decimal_trim(a);
+}
+
+/* Divide by 2^k, for k <= DECIMAL_SHIFT. */
+static void
+decimal_right_shift(struct decimal *a, unsigned k)
+{
+    uint64_t mask = ((uint64_t)1 << k) - 1;
+    uint64_t acc = 0;
+    int r = 0, w = 0;
+
+    for (; acc >> k == 0; r++) {
+        if (r >= a->nd) {
+            if (acc == 0) {
+                a->nd = 0;
+                return;
+            }
+            while (acc >> k == 0) {
+                acc *= 10;
+                r++;
+            }
+            break;
+        }
+        acc = acc * 10 + a->d[r];
+    }
+    a->dp -= r - 1;
+
+    for (; r < a->nd; r++) {
+        a->d[w++] = (unsigned char)(acc >> k);
+        acc = (acc & mask) * 10 + a->d[r];
+    }
+    for (; acc > 0; acc = (acc & mask) * 10) {
+        if (w < DECIMAL_DIGITS)
+            a->d[w++] = (unsigned char)(acc >> k);
+        else if (acc >> k)
+            a->trunc = 1;
+    }
+    a->nd = w;
+    decimal_trim(a);
+}
+
+static void
+decimal_shift(struct decimal *a, int k)
+{
+    if (a->nd == 0)
+        return;
+    for (; k > DECIMAL_SHIFT; k -= DECIMAL_SHIFT)
+        decimal_left_shift(a, DECIMAL_SHIFT);
+    for (; k < -DECIMAL_SHIFT; k += DECIMAL_SHIFT)
+        decimal_right_shift(a, DECIMAL_SHIFT);
+    if (k > 0)
+        decimal_left_shift(a, k);
+    else if (k < 0)
+        decimal_right_shift(a, -k);
+}
+
+/* The integer part, rounded half to even. */
+static uint64_t
+decimal_round(const struct decimal *a)
+{
+    uint64_t n = 0;
+    int i, up;
+
+    if (a->dp > 20)
+        return (uint64_t)-1;
+    for (i = 0; i < a->dp && i < a->nd; i++)
+        n = n * 10 + a->d[i];
+    for (; i < a->dp; i++)
+        n *= 10;
+
+    if (a->dp < 0 || a->dp >= a->nd)
+        up = 0;
+    else if (a->d[a->dp] == 5 && a->dp + 1 == a->nd)
+        up = a->trunc || (a->dp > 0 && a->d[a->dp - 1] % 2 == 1);
+    else
+        up = a->d[a->dp] >= 5;
+    return n + up;
+}
+
+static double
+decimal_double(struct decimal *a, int neg)
+{
+    static const int powtab[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+    const int ntab = sizeof(powtab) / sizeof(*powtab);
+    uint64_t mant, bits;
+    int e2 = 0;
+
+    if (a->nd == 0) {
+        bits = 0;
+        goto out;
+    } else if (a->dp > 310) {
+        goto overflow;
+    } else if (a->dp < -330) {
+        bits = 0;
+        goto out;
+    }
+
+    /* Scale by powers of two into [0.5, 1). */
+    while (a->dp > 0) {
+        int n = a->dp >= ntab ? 27 : powtab[a->dp];
+        decimal_shift(a, -n);
+        e2 += n;
+    }
+    while (a->dp < 0 || (a->dp == 0 && a->d[0] < 5)) {
+        int n = -a->dp >= ntab ? 27 : powtab[-a->dp];
+        decimal_shift(a, n);
+        e2 -= n;
+    }
+
+    /* The double's significand is in [1, 2), and its smallest normal
+       exponent is -1022. */
+    e2--;
+    if (e2 < -1022) {
+        decimal_shift(a, e2 + 1022);
+        e2 = -1022;
+    }
+    if (e2 > 1023)
+        goto overflow;
+
+    decimal_shift(a, 53);
+    mant = decimal_round(a);
+    if (mant == (uint64_t)2 << 52) {
+        mant >>= 1;
+        if (++e2 > 1023)
+            goto overflow;
+    }
+    if (!(mant & ((uint64_t)1 << 52)))
+        e2 = -1023; /* subnormal */
+
+    bits = (uint64_t)(e2 + 1023) << 52 | (mant & 0x000fffffffffffff);
+    goto out;
+
+overflow:
+    bits = (uint64_t)0x7ff << 52;
+out:
+    if (neg)
+        bits |= 0x8000000000000000;
+    return bits_double(bits);
+}
+
+/* Scan the JSON number at the start of [p, end), which need not be
+   valid, but conversion stops at the first byte that does not fit. */
+static void
+decimal_assign(struct decimal *a, const char *p, const char *end)
+{
+    long exp = 0;
+    int esign = 1;
+    int point = 0;
+
+    a->nd = a->dp = a->trunc = 0;
+    if (p < end && *p == '-')
+        p++;
+    for (; p < end; p++) {
+        if (*p == '.' && !point) {
+            point = 1;
+        } else if (is_digit(*p)) {
+            int d = *p - '0';
+            if (a->nd == 0 && d == 0) {
+                a->dp -= point;
+                continue;
+            }
+            if (a->nd < DECIMAL_DIGITS)
+                a->d[a->nd++] = d;
+            else if (d != 0)
+                a->trunc = 1;
+            a->dp += !point;
+        } else {
+            break;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+            esign = *p++ == '-' ? -1 : 1;
+        for (; p < end && is_digit(*p); p++)
+            if (exp < 100000)
+                exp = exp * 10 + (*p - '0');
+    }
+    a->dp += esign * exp;
+    decimal_trim(a);
+}
+
+/* Scan the JSON number at the start of [p, end) the way the lexer would
+   have, for text that did not come from a number token. The text need
+   not be valid, as the scan stops at the first byte that does not fit. */
+static void
+scan_number(struct json_number *n, const char *p, const char *end)
+{
+    long power = 0;
+    int sign = 1;
+
+    n->mantissa = 0;
+    n->exponent = 0;
+    n->flags = 0;
+    if (p < end && *p == '-') {
+        n->flags |= NUMBER_NEGATIVE;
+        p++;
+    }
+    for (; p < end && is_digit(*p); p++)
+        add_digit(n, *p, DIGITS_INTEGER);
+    if (p < end && *p == '.')
+        for (p++; p < end && is_digit(*p); p++)
+            add_digit(n, *p, DIGITS_FRACTION);
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+            sign = *p++ == '-' ? -1 : 1;
+        for (; p < end && is_digit(*p); p++)
+            if (power < 100000)
+                power = power * 10 + (*p - '0');
+    }
+    n->exponent += sign * power;
+}
+
+/* Convert a number to the nearest double. Its text is only needed by
+   the exact fallback. */
+static double
+number_double(const struct json_number *n, const char *p, const char *end)
+{
+    static const double exact[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    uint64_t w = n->mantissa;
+    long e10 = n->exponent;
+    int neg = !!(n->flags & NUMBER_NEGATIVE);
+    int inexact = !!(n->flags & NUMBER_INEXACT);
+    double result, alt;
+    struct decimal a;
+
+    if (w == 0 || e10 < POW10_MIN)
+        return bits_double((uint64_t)neg << 63);
+    if (e10 > POW10_MAX)
+        return bits_double((uint64_t)neg << 63 | (uint64_t)0x7ff << 52);
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    /* Both operands are exact, so the one rounding is correct. */
+    if (!inexact && w <= (uint64_t)1 << 53 && e10 >= -22 && e10 <= 22) {
+        result = (double)w;
+        result = e10 < 0 ? result / exact[-e10] : result * exact[e10];
+        return neg ? -result : result;
+    }
+#else
+    (void)exact;
+#endif
+
+    /* An inexact mantissa lies between w and w + 1, so if both round
+       the same way, so does the number itself. */
+    if (eisel_lemire(w, (int)e10, neg, &result) &&
+        (!inexact || (w + 1 != 0 &&
+                      eisel_lemire(w + 1, (int)e10, neg, &alt) &&
+                      alt == result)))
+        return result;
+
+    decimal_assign(&a, p, end);
+    return decimal_double(&a, neg);
+}
+
+const char *json_get_string(json_stream *json, size_t *length)
+{
+    if (json->flags & JSON_FLAG_DEFERRED) {
+        /* Should this fail, the string reads as empty. */
+        json->flags &= ~JSON_FLAG_DEFERRED;
+        if (pushbytes(json, json->data.slice, json->data.slice_length) == 0)
+            pushchar(json, '\0');
+    }
+    if (length != NULL)
+        *length = json->data.string_fill;
+    if (json->data.string == NULL)
+        return "";
+    else
+        return json->data.string;
+}
+
+bool json_get_slice(json_stream *json, const char **ptr, size_t *length)
+{
+    if (json->data.slice != NULL) {
+        *ptr = json->data.slice;
+        *length = json->data.slice_length;
+        return true;
+    }
+    *ptr = json_get_string(json, length);
+    if (*length > 0)
+        --*length;
+    return false;
+}
+
+uint64_t json_get_string_hash(json_stream *json)
+{
+    const char *p;
+    size_t n;
+    json_get_slice(json, &p, &n);
+    return string_hash(p, n);
+}
+
+/* Returns the number's parts, as gathered by the lexer for a number
+   token, or by scanning the text of any other. */
+static const char *
+get_number(json_stream *json, struct json_number *n, size_t *length)
+{
+    const char *p = json_get_string(json, length);
+    if (json->data.number.flags & NUMBER_VALID)
+        *n = json->data.number;
+    else
+        scan_number(n, p, p + *length);
+    return p;
+}
+
+double json_get_number(json_stream *json)
+{
+    struct json_number n;
+    size_t length;
+    const char *p = get_number(json, &n, &length);
+    return number_double(&n, p, p + length);
+}
+
+/* The magnitude of an integral number, or zero if it has a fraction,
+   with *overflow set if it does not fit. */
+static uint64_t
+number_integer(const struct json_number *n, int *integral, int *overflow)
+{
+    uint64_t w = n->mantissa;
+    long e = n->exponent;
+
+    *integral = !(n->flags & NUMBER_INEXACT);
+    *overflow = 0;
+    if (w == 0)
+        return 0;
+    /* A mantissa is only full once another digit would not fit, so if
+       any of the digits dropped were part of the integer, it is too big. */
+    if (n->flags & NUMBER_INEXACT && e > 0) {
+        *overflow = 1;
+        return UINT64_MAX;
+    }
+    for (; e < 0 && w != 0; e++) {
+        if (w % 10 != 0)
+            *integral = 0;
+        w /= 10;
+    }
+    for (; e > 0; e--) {
+        if (w > UINT64_MAX / 10) {
+            *overflow = 1;
+            return UINT64_MAX;
+        }
+        w *= 10;
+    }
+    return w;
+}
+
+static bool
+number_int64(const struct json_number *n, int64_t *value)
+{
+    int integral, overflow;
+    uint64_t w = number_integer(n, &integral, &overflow);
+
+    if (n->flags & NUMBER_NEGATIVE) {
+        if (overflow || w > (uint64_t)INT64_MAX + 1) {
+            *value = INT64_MIN;
+            return false;
+        }
+        *value = w == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)w;
+    } else {
+        if (overflow || w > INT64_MAX) {
+            *value = INT64_MAX;
+            return false;
+        }
+        *value = w;
+    }
+    return integral;
+}
+
+bool json_get_int64(json_stream *json, int64_t *value)
+{
+    struct json_number n;
+    size_t length;
+    get_number(json, &n, &length);
+    return number_int64(&n, value);
+}
+
+bool json_get_uint64(json_stream *json, uint64_t *value)
+{
+    struct json_number n;
+    size_t length;
+    int integral, overflow;
+    uint64_t w;
+
+    get_number(json, &n, &length);
+    w = number_integer(&n, &integral, &overflow);
+    if (n.flags & NUMBER_NEGATIVE && w != 0) {
+        *value = 0;
+        return false;
+    }
+    *value = w;
+    return integral && !overflow;
+}
+
+bool json_get_decimal(json_stream *json, int64_t *mantissa, long *exponent)
+{
+    struct json_number n;
+    size_t length;
+    int exact;
+
+    get_number(json, &n, &length);
+    exact = !(n.flags & NUMBER_INEXACT);
+    if (n.flags & NUMBER_NEGATIVE && n.mantissa == (uint64_t)INT64_MAX + 1) {
+        *mantissa = INT64_MIN;
+        *exponent = n.exponent;
+        return exact;
+    }
+    if (n.mantissa > INT64_MAX) {
+        exact &= n.mantissa % 10 == 0;
+        n.mantissa /= 10;
+        n.exponent++;
+    }
+    *mantissa = n.flags & NUMBER_NEGATIVE ? -(int64_t)n.mantissa
+                                          : (int64_t)n.mantissa;
+    *exponent = n.exponent;
+    return exact;
+}
+
+const char *json_get_error(json_stream *json)
+{
+    return json->flags & JSON_FLAG_ERROR ? json->errmsg : NULL;
+}
+
+size_t json_get_lineno(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    count_lines(json, source->counted, source->mark);
+    source->counted = source->mark;
+    return json->lineno;
+}
+
+size_t json_get_position(json_stream *json)
+{
+    return json->source.position + (json->source.cursor - json->source.base);
+}
+
+size_t json_get_depth(json_stream *json)
+{
+    return json->stack_top + 1;
+}
+
+/* Return the current parsing context, that is, JSON_OBJECT if we are inside
+   an object, JSON_ARRAY if we are inside an array, and JSON_DONE if we are
+   not yet/anymore in either.
+
+   Additionally, for the first two cases, also return the number of parsing
+   events that have already been observed at this level with json_next/peek(),
+   exactly with json_set_counts(), or else as 0, 1 or 2 for none, an odd or
+   an even number. In particular, inside an object, an odd number would
+   indicate that the just observed JSON_STRING event is a member name.
+*/
+enum json_type json_get_context(json_stream *json, size_t *count)
+{
+    if (json->stack_top == (size_t)-1)
+        return JSON_DONE;
+
+    unsigned entry = stack_get(json, json->stack_top);
+    if (count != NULL) {
+        if (json->flags & JSON_FLAG_COUNTS)
+            *count = json->counts[json->stack_top];
+        else
+            *count = entry & STACK_STATE;
+    }
+
+    return entry & STACK_OBJECT ? JSON_OBJECT : JSON_ARRAY;
+}
+
+int json_source_get(json_stream *json)
+{
+    int c = source_get(json);
+    if (c == '\n' && json->source.cursor == json->source.base)
+        json->lineno++;
+    json->source.mark = json->source.cursor;
+    return c;
+}
+
+int json_source_peek(json_stream *json)
+{
+    return source_peek(json);
+}
+
+void json_open_buffer(json_stream *json, const void *buffer, size_t size)
+{
+    init(json);
+    json->flags |= JSON_FLAG_BUFFER;
+    json->source.get = buffer_get;
+    json->source.peek = buffer_peek;
+    json->source.source.buffer.buffer = (const char *)buffer;
+    json->source.source.buffer.length = size;
+    json->source.base = (const unsigned char *)buffer;
+    json->source.cursor = json->source.base;
+    json->source.counted = json->source.base;
+    json->source.mark = json->source.base;
+    json->source.limit = json->source.base + size;
+}
+
+bool json_validate_utf8(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    if (!(json->flags & JSON_FLAG_BUFFER))
+        return false;
+    if (utf8_valid(source->cursor, source->limit))
+        json->flags |= JSON_FLAG_UTF8;
+    return (json->flags & JSON_FLAG_UTF8) != 0;
+}
+
+bool json_build_index(json_stream *json)
+{
+    struct json_source *source = &json->source;
+    const unsigned char *p = source->cursor;
+    const unsigned char *end = source->limit;
+    unsigned char tail[64];
+    uint64_t escape = 0, string = 0;
+    uint32_t *index = NULL;
+    size_t count = 0, size = 0;
+
+    if (!(json->flags & JSON_FLAG_BUFFER) || source->index != NULL)
+        return source->index != NULL;
+    if ((uint64_t)(end - source->base) >= UINT32_MAX)
+        return false;
+
+    for (; p < end; p += 64) {
+        const unsigned char *block = p;
+        struct index_masks m;
+        uint64_t quote, inside, bits;
+
+        /* Room for a block's worth, strays included, and the end */
+        if (size - count < 68) {
+            uint32_t *grown;
+            size_t old = size;
+            size = size ? size * 2 : 1024;
+            grown = (uint32_t *)json->alloc.realloc(json->alloc.ctx, index,
+                                                    old * sizeof(*index),
+                                                    size * sizeof(*index));
+            if (grown == NULL) {
+                json->alloc.free(json->alloc.ctx, index, old * sizeof(*index));
+                return false;
+            }
+            index = grown;
+        }
+
+        if (end - p < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p, end - p);
+            block = tail;
+        }
+        index_classify(block, &m);
+
+        quote = m.quote & ~index_escaped(m.backslash, &escape);
+        inside = prefix_xor(quote) ^ string;
+        string = 0 - (inside >> 63);
+        bits = (m.open | m.close) & ~inside;
+
+        count += index_flatten(index + count, (uint32_t)(p - source->base), bits);
+    }
+
+    if (index == NULL) {
+        index = (uint32_t *)json->alloc.malloc(json->alloc.ctx, sizeof(*index));
+        if (index == NULL)
+            return false;
+        size = 1;
+    }
+    index[count] = (uint32_t)(end - source->base);
+    source->index = index;
+    source->index_size = size;
+    source->index_next = 0;
+    return true;
+}
+
+void json_open_feed(json_stream *json)
+{
+    init(json);
+    json->flags |= JSON_FLAG_FEED;
+    json->source.get = feed_get;
+    json->source.peek = feed_get;
+    json->source.source.feed.wait = (size_t)-1;
+}
+
+int json_feed(json_stream *json, const void *data, size_t size)
+{
+    struct json_source *source = &json->source;
+    size_t keep = source->limit - source->cursor;
+
+    if (size == 0) {
+        json->flags |= JSON_FLAG_FEED_END;
+        return 0;
+    }
+
+    /* Move what is left to the front, then make room after it */
+    count_lines(json, source->counted, source->mark);
+    source->position += source->cursor - source->base;
+    if (source->block != NULL)
+        memmove(source->block, source->cursor, keep);
+    if (source->block == NULL || keep + size > source->block_size) {
+        size_t old = source->block != NULL ? source->block_size : 0;
+        size_t grown = source->block_size;
+        unsigned char *block;
+        while (grown < keep + size && grown <= SIZE_MAX / 2)
+            grown *= 2;
+        if (grown < keep + size)
+            grown = keep + size;
+        block = (unsigned char *)json->alloc.realloc(json->alloc.ctx, source->block,
+                                                     old, grown);
+        if (block == NULL) {
+            source->base = source->cursor = source->block;
+            source->counted = source->mark = source->block;
+            source->limit = source->block != NULL ? source->block + keep : empty_window;
+            json_error(json, "%s", "out of memory");
+            return -1;
+        }
+        source->block = block;
+        source->block_size = grown;
+    }
+    memcpy(source->block + keep, data, size);
+    source->base = source->block;
+    source->cursor = source->block;
+    source->counted = source->block;
+    source->mark = source->block;
+    source->limit = source->block + keep + size;
+    return 0;
+}
+
+void json_open_string(json_stream *json, const char *string)
+{
+    json_open_buffer(json, string, strlen(string));
+}
+
+/* Only a regular file is read in blocks. Anything else, such as a pipe
+   or a socket, may be waiting on a writer, and fread() on a whole block
+   would hold back values that have already arrived, so it is read a
+   byte at a time, as for a buffer size of zero.
+ */
+void json_open_stream(json_stream *json, FILE * stream)
+{
+    init(json);
+    json->source.get = stream_block_get;
+    json->source.peek = stream_block_peek;
+    json->source.source.stream.stream = stream;
+    json->source.source.stream.regular = 1;
+#ifndef _WIN32
+    if (stream != NULL) {
+        struct stat st;
+        int fd = fileno(stream);
+        if (fd != -1 && fstat(fd, &st) == 0 && !S_ISREG(st.st_mode)) {
+            json->source.source.stream.regular = 0;
+            json->source.get = stream_get;
+            json->source.peek = stream_peek;
+        }
+    }
+#endif
+}
+
+void json_open_fd(json_stream *json, int fd)
+{
+    init(json);
+    json->source.get = fd_get;
+    json->source.peek = fd_peek;
+    json->source.source.fd.fd = fd;
+}
+
+/* Regular files are mapped and parsed as a buffer, released again by
+   json_close(). Anything that cannot be mapped, such as a pipe or an
+   empty file, is read in blocks as by json_open_fd() instead.
+ */
+int json_open_file(json_stream *json, const char *path)
+{
+#ifdef _WIN32
+    FILE *stream = fopen(path, "rb");
+    json_open_stream(json, stream);
+    if (stream == NULL) {
+        json_error(json, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        init(json);
+        json_error(json, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (size_t)st.st_size == (unsigned long long)st.st_size) {
+        size_t size = st.st_size;
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+            json_open_buffer(json, map, size);
+            json->flags |= JSON_FLAG_MAPPED;
+            return 0;
+        }
+    }
+    json_open_fd(json, fd);
+#endif
+    json->flags |= JSON_FLAG_OWNED;
+    return 0;
+}
+
+void json_set_buffer_size(json_stream *json, size_t size)
+{
+    struct json_source *source = &json->source;
+    if (source->block != NULL)
+        return; /* reading has already begun */
+    if (source->get == stream_block_get || source->get == stream_get) {
+        int block = size > 0 && source->source.stream.regular;
+        source->get = block ? stream_block_get : stream_get;
+        source->peek = block ? stream_block_peek : stream_peek;
+    }
+    source->block_size = size > 0 ? size : 1;
+}
+
+static int user_get(struct json_source *json)
+{
+    int c = json->source.user.get(json->source.user.ptr);
+    if (c != EOF)
+        json->position++;
+    return c;
+}
+
+static int user_peek(struct json_source *json)
+{
+    return json->source.user.peek(json->source.user.ptr);
+}
+
+void json_open_user(json_stream *json, json_user_io get, json_user_io peek, void *user)
 {
     init(json);
     json->source.get = user_get;
@@ -1002,21 +3910,1264 @@ void json_open_user(json_stream *json, json_user_io get, json_user_io peek, void
     json->source.source.user.peek = peek;
 }
 
-void json_set_allocator(json_stream *json, json_allocator *a)
+void json_open_reader(json_stream *json, json_user_read read, void *user)
+{
+    init(json);
+    json->source.get = reader_get;
+    json->source.peek = reader_peek;
+    json->source.source.reader.ptr = user;
+    json->source.source.reader.read = read;
+}
+
+void json_set_allocator(json_stream *json, json_allocator *a)
+{
+    release_idle(json);
+    json->plain = *a;
+    set_plain_allocator(json);
+}
+
+void json_set_context_allocator(json_stream *json, const json_context_allocator *a)
+{
+    release_idle(json);
+    json->alloc = *a;
+}
+
+/* Arena memory is handed out in multiples of this, which is enough for
+   any of the library's own types. */
+#define ARENA_ALIGN 16
+
+struct json_arena_chunk {
+    struct json_arena_chunk *next;
+};
+
+#define ARENA_CHUNK_HEADER \
+    ((sizeof(struct json_arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void json_arena_init(json_arena *arena, void *buffer, size_t size)
+{
+    unsigned char *start = (unsigned char *)buffer;
+    size_t skip = (ARENA_ALIGN - (uintptr_t)start % ARENA_ALIGN) % ARENA_ALIGN;
+    arena->buffer = start;
+    arena->size = size;
+    arena->chunks = NULL;
+    arena->chunk_size = PDJSON_ARENA_CHUNK;
+    arena->last = NULL;
+    if (start == NULL || size < skip) {
+        arena->cursor = NULL;
+        arena->limit = NULL;
+    } else {
+        arena->cursor = start + skip;
+        arena->limit = start + size;
+    }
+}
+
+void json_arena_release(json_arena *arena)
+{
+    struct json_arena_chunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct json_arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    json_arena_init(arena, arena->buffer, arena->size);
+}
+
+static void *
+arena_malloc(void *ctx, size_t size)
+{
+    json_arena *arena = (json_arena *)ctx;
+    unsigned char *p;
+
+    if (size > SIZE_MAX - ARENA_CHUNK_HEADER - ARENA_ALIGN)
+        return NULL;
+    size = size ? (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1) : ARENA_ALIGN;
+
+    /* Chunks double in size, so the number of them stays small */
+    if (size > (size_t)(arena->limit - arena->cursor)) {
+        struct json_arena_chunk *chunk;
+        size_t chunk_size = arena->chunk_size;
+        while (chunk_size - ARENA_CHUNK_HEADER < size && chunk_size < SIZE_MAX / 2)
+            chunk_size *= 2;
+        if (chunk_size - ARENA_CHUNK_HEADER < size)
+            chunk_size = size + ARENA_CHUNK_HEADER;
+        chunk = (struct json_arena_chunk *)malloc(chunk_size);
+        if (chunk == NULL)
+            return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->chunk_size = chunk_size < SIZE_MAX / 2 ? chunk_size * 2 : chunk_size;
+        arena->cursor = (unsigned char *)chunk + ARENA_CHUNK_HEADER;
+        arena->limit = (unsigned char *)chunk + chunk_size;
+    }
+
+    p = arena->cursor;
+    arena->cursor += size;
+    arena->last = p;
+    return p;
+}
+
+/* The latest allocation grows and shrinks in place while it fits, and
+   is given back by free(). Anything else stays until the release. */
+static void *
+arena_realloc(void *ctx, void *ptr, size_t old_size, size_t size)
+{
+    json_arena *arena = (json_arena *)ctx;
+    unsigned char *p;
+
+    if (ptr != NULL && ptr == arena->last && size <= SIZE_MAX - ARENA_ALIGN) {
+        size_t rounded = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (rounded <= (size_t)(arena->limit - arena->last)) {
+            arena->cursor = arena->last + rounded;
+            return ptr;
+        }
+    }
+    p = (unsigned char *)arena_malloc(ctx, size);
+    if (p != NULL && ptr != NULL)
+        memcpy(p, ptr, old_size < size ? old_size : size);
+    return p;
+}
+
+static void
+arena_free(void *ctx, void *ptr, size_t size)
+{
+    json_arena *arena = (json_arena *)ctx;
+    (void)size;
+    if (ptr != NULL && ptr == arena->last) {
+        arena->cursor = arena->last;
+        arena->last = NULL;
+    }
+}
+
+void json_set_arena(json_stream *json, json_arena *arena)
+{
+    release_idle(json);
+    json->alloc.malloc = arena_malloc;
+    json->alloc.realloc = arena_realloc;
+    json->alloc.free = arena_free;
+    json->alloc.ctx = arena;
+}
+
+/* Tape words carry the event type in the top byte and a payload below
+   it: for a container's start, the index just past its end; for an
+   end, the index of its start; for a string or number, the offset of
+   its text, which is stored as a size_t length, the bytes and a nul. */
+#define TAPE_SHIFT 56
+#define TAPE_PAYLOAD ((UINT64_C(1) << TAPE_SHIFT) - 1)
+
+static void *
+tape_grow(json_arena *arena, void *array, size_t *size, size_t need, size_t width)
+{
+    size_t grown = *size;
+    void *p;
+    while (grown < need) {
+        if (grown > SIZE_MAX / 2 / width)
+            return NULL;
+        grown *= 2;
+    }
+    p = arena_realloc(arena, array, *size * width, grown * width);
+    if (p != NULL)
+        *size = grown;
+    return p;
+}
+
+const json_tape *json_parse_tape(json_stream *json, json_arena *arena)
+{
+    size_t depth = json_get_depth(json);
+    enum json_type type;
+    json_tape *tape;
+    size_t count = 0, words_size = 64, fill = 0, strings_size = 1024;
+    size_t part = (size_t)-1;
+    uint64_t *words;
+    char *strings;
+    uint64_t open = TAPE_PAYLOAD;
+
+    if (!feed_whole(json, "json_parse_tape"))
+        return NULL;
+    type = json_next(json);
+
+    /* The end of the enclosing container is not a value */
+    if (type == JSON_ERROR || type == JSON_DONE || type == JSON_INCOMPLETE ||
+        type == JSON_OBJECT_END || type == JSON_ARRAY_END)
+        return NULL;
+
+    tape = (json_tape *)arena_malloc(arena, sizeof(*tape));
+    words = (uint64_t *)arena_malloc(arena, words_size * sizeof(*words));
+    strings = (char *)arena_malloc(arena, strings_size);
+    if (tape == NULL || words == NULL || strings == NULL) {
+        json_error(json, "%s", "out of memory");
+        return NULL;
+    }
+
+    /* Open containers are chained through their start words until
+       their ends turn up. The first event has already been read. */
+    do {
+        uint64_t payload = 0;
+
+        if (count > 0 || part != (size_t)-1)
+            type = json_next(json);
+        if (type == JSON_ERROR || type == JSON_DONE || type == JSON_INCOMPLETE)
+            return NULL;
+        if (count == words_size) {
+            words = (uint64_t *)tape_grow(arena, words, &words_size, count + 1, sizeof(*words));
+            if (words == NULL)
+                goto oom;
+        }
+
+        switch (type) {
+        case JSON_OBJECT:
+        case JSON_ARRAY:
+            payload = open;
+            open = count;
+            break;
+        case JSON_OBJECT_END:
+        case JSON_ARRAY_END:
+            payload = open;
+            open = words[open] & TAPE_PAYLOAD;
+            words[payload] = (words[payload] & ~TAPE_PAYLOAD) | (count + 1);
+            break;
+        case JSON_STRING_PART:
+        case JSON_STRING:
+        case JSON_NUMBER: {
+            /* A string in parts is put back together, its length going
+               in once the last part is in */
+            const char *p;
+            size_t n;
+            json_get_slice(json, &p, &n);
+            if (fill + sizeof(n) + n + 1 > strings_size) {
+                strings = (char *)tape_grow(arena, strings, &strings_size,
+                                            fill + sizeof(n) + n + 1, 1);
+                if (strings == NULL)
+                    goto oom;
+            }
+            if (part == (size_t)-1) {
+                part = fill;
+                fill += sizeof(n);
+            }
+            memcpy(strings + fill, p, n);
+            fill += n;
+            if (type == JSON_STRING_PART)
+                continue;
+            payload = part;
+            n = fill - part - sizeof(n);
+            memcpy(strings + part, &n, sizeof(n));
+            strings[fill++] = '\0';
+            part = (size_t)-1;
+            break;
+        }
+        default:
+            break;
+        }
+        words[count++] = (uint64_t)type << TAPE_SHIFT | payload;
+    } while (part != (size_t)-1 || json_get_depth(json) > depth);
+
+    tape->words = words;
+    tape->size = count;
+    tape->strings = strings;
+    tape->strings_size = fill;
+    return tape;
+
+oom:
+    json_error(json, "%s", "out of memory");
+    return NULL;
+}
+
+size_t json_next_batch(json_stream *json, json_token *tokens, size_t n, json_arena *arena)
+{
+    enum json_type (*step)(json_stream *) =
+        json->flags & JSON_FLAG_FEED ? feed_next : next_event;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        json_token *token = &tokens[i];
+        enum json_type type = step(json);
+
+        token->type = type;
+        token->depth = json->stack_top + 1;
+        token->text = NULL;
+        token->length = 0;
+        if (type == JSON_STRING || type == JSON_STRING_PART || type == JSON_NUMBER) {
+            /* In place where possible, otherwise copied to the arena */
+            if (json->data.slice != NULL) {
+                token->text = json->data.slice;
+                token->length = json->data.slice_length;
+            } else {
+                char *copy = (char *)arena_malloc(arena, json->data.string_fill);
+                if (copy == NULL) {
+                    json_error(json, "%s", "out of memory");
+                    token->type = JSON_ERROR;
+                    return i + 1;
+                }
+                memcpy(copy, json->data.string, json->data.string_fill);
+                token->text = copy;
+                token->length = json->data.string_fill - 1;
+            }
+        } else if (type == JSON_DONE || type == JSON_ERROR || type == JSON_INCOMPLETE) {
+            return i + 1;
+        }
+    }
+    return n;
+}
+
+enum json_type json_tape_type(const json_tape *tape, size_t i)
+{
+    return (enum json_type)(tape->words[i] >> TAPE_SHIFT);
+}
+
+size_t json_tape_next(const json_tape *tape, size_t i)
+{
+    enum json_type type = json_tape_type(tape, i);
+    if (type == JSON_OBJECT || type == JSON_ARRAY)
+        return (size_t)(tape->words[i] & TAPE_PAYLOAD);
+    return i + 1;
+}
+
+const char *json_tape_string(const json_tape *tape, size_t i, size_t *length)
+{
+    enum json_type type = json_tape_type(tape, i);
+    const char *p = tape->strings + (tape->words[i] & TAPE_PAYLOAD);
+    size_t n;
+    if (type != JSON_STRING && type != JSON_NUMBER) {
+        if (length != NULL)
+            *length = 0;
+        return "";
+    }
+    memcpy(&n, p, sizeof(n));
+    if (length != NULL)
+        *length = n;
+    return p + sizeof(n);
+}
+
+double json_tape_number(const json_tape *tape, size_t i)
+{
+    struct json_number n;
+    size_t length;
+    const char *p = json_tape_string(tape, i, &length);
+    scan_number(&n, p, p + length);
+    return number_double(&n, p, p + length);
+}
+
+bool json_tape_int64(const json_tape *tape, size_t i, int64_t *value)
+{
+    struct json_number n;
+    size_t length;
+    const char *p = json_tape_string(tape, i, &length);
+    scan_number(&n, p, p + length);
+    return number_int64(&n, value);
+}
+
+size_t json_tape_member(const json_tape *tape, size_t object, const char *name)
+{
+    size_t i, n = strlen(name);
+    if (json_tape_type(tape, object) != JSON_OBJECT)
+        return SIZE_MAX;
+    for (i = object + 1; json_tape_type(tape, i) == JSON_STRING; i = json_tape_next(tape, i + 1)) {
+        size_t length;
+        const char *key = json_tape_string(tape, i, &length);
+        if (length == n && !memcmp(key, name, n))
+            return i + 1;
+    }
+    return SIZE_MAX;
+}
+
+void json_set_raw_skip(json_stream *json, bool raw)
+{
+    if (raw)
+        json->flags |= JSON_FLAG_RAW_SKIP;
+    else
+        json->flags &= ~JSON_FLAG_RAW_SKIP;
+}
+
+/* Either area may be left out (NULL) to have it allocated as usual. The
+   stream's own allocations, if reading has begun, are given back. */
+void json_set_storage(json_stream *json, void *stack, size_t stack_size,
+                      void *string, size_t string_size)
+{
+    if (json->stack_top != (size_t)-1)
+        return; /* not inside a value */
+    if (stack != NULL) {
+        if (!(json->flags & JSON_FLAG_FIXED_STACK))
+            json->alloc.free(json->alloc.ctx, json->stack, json->stack_size / 2);
+        json->stack = (unsigned char *)stack;
+        json->stack_size = stack_size * 2;
+        json->flags |= JSON_FLAG_FIXED_STACK;
+    }
+    if (string != NULL && string_size > 0) {
+        if (!(json->flags & JSON_FLAG_FIXED_STRING))
+            json->alloc.free(json->alloc.ctx, json->data.string,
+                             json->data.string != NULL ? json->data.string_size : 0);
+        json->data.string = (char *)string;
+        json->data.string_size = string_size;
+        json->data.string_fill = 0;
+        json->data.string[0] = '\0';
+        json->flags |= JSON_FLAG_FIXED_STRING;
+    }
+}
+
+void json_set_counts(json_stream *json, bool counts)
+{
+    if (json->stack_top != (size_t)-1)
+        return; /* not inside a value */
+    if (counts)
+        json->flags |= JSON_FLAG_COUNTS;
+    else
+        json->flags &= ~JSON_FLAG_COUNTS;
+}
+
+void json_set_string_parts(json_stream *json, size_t size)
+{
+    json->data.part_size = size;
+}
+
+void json_set_streaming(json_stream *json, bool streaming)
+{
+    if (streaming)
+        json->flags |= JSON_FLAG_STREAMING;
+    else
+        json->flags &= ~JSON_FLAG_STREAMING;
+}
+
+void json_close(json_stream *json)
+{
+    json->alloc.free(json->alloc.ctx, json->source.index,
+                     json->source.index_size * sizeof(*json->source.index));
+    json->alloc.free(json->alloc.ctx, json->source.block,
+                     json->source.block != NULL ? json->source.block_size : 0);
+    if (!(json->flags & JSON_FLAG_FIXED_STRING))
+        json->alloc.free(json->alloc.ctx, json->data.string,
+                         json->data.string != NULL ? json->data.string_size : 0);
+    if (!(json->flags & JSON_FLAG_FIXED_STACK))
+        json->alloc.free(json->alloc.ctx, json->stack, json->stack_size / 2);
+    json->alloc.free(json->alloc.ctx, json->counts,
+                     json->counts_size * sizeof(*json->counts));
+
+#ifndef _WIN32
+    if (json->flags & JSON_FLAG_MAPPED)
+        munmap((void *)json->source.source.buffer.buffer,
+               json->source.source.buffer.length);
+#endif
+    if (json->flags & JSON_FLAG_OWNED) {
+        if (json->source.get == fd_get)
+            close(json->source.source.fd.fd);
+        else if (json->source.source.stream.stream != NULL)
+            fclose(json->source.source.stream.stream);
+    }
+}
+
+/* Parallel NDJSON. The buffer is cut into chunks of about
+   PDJSON_NDJSON_CHUNK bytes, each beginning just past the first newline
+   at or after its nominal start, so that any worker can find its own
+   chunk's bounds without reference to the others. Workers take chunks in
+   order from a shared counter and call the record callback on each line
+   of theirs. For ordered results, each chunk in flight has a slot in a
+   ring where its results are kept until the calling thread has passed
+   them on, and workers wait rather than run more than a ring's length
+   ahead of it.
+ */
+#ifndef PDJSON_NDJSON_CHUNK
+#  define PDJSON_NDJSON_CHUNK (1 << 20)
+#endif
+
+struct ndjson_result {
+    void *result;
+    size_t offset;
+};
+
+struct ndjson_slot {
+    struct ndjson_result *results;
+    size_t count;
+    size_t size;
+    int done;
+};
+
+struct ndjson {
+    const char *buffer;
+    size_t size;
+    json_ndjson_record record;
+    json_ndjson_result result;
+    void *user;
+
+    size_t nchunks;
+    size_t next;          /* next chunk to be taken */
+    size_t emitted;       /* chunks whose results have been passed on */
+    size_t nslots;
+    struct ndjson_slot *slots;
+    int failed;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+};
+
+/* Open a buffer on a stream that has been used before, keeping its stack
+   and string allocations. Anything else the last record left behind,
+   such as an index or counts, is freed as by json_close(), and storage
+   the caller supplied is let go. Should the last record have set an
+   allocator of its own, nothing is kept, as the next starts out with
+   the default one. */
+static void
+reopen_buffer(json_stream *json, const char *buffer, size_t size)
+{
+    unsigned char *stack = NULL;
+    size_t stack_size = 0;
+    char *string = NULL;
+    size_t string_size = 0;
+
+    if (json->alloc.malloc != plain_malloc || json->alloc.ctx != &json->plain ||
+        json->plain.malloc != malloc || json->plain.realloc != realloc ||
+        json->plain.free != free)
+        release_buffers(json);
+    if (!(json->flags & JSON_FLAG_FIXED_STACK)) {
+        stack = json->stack;
+        stack_size = json->stack_size;
+    }
+    if (!(json->flags & JSON_FLAG_FIXED_STRING)) {
+        string = json->data.string;
+        string_size = json->data.string_size;
+    }
+    json->alloc.free(json->alloc.ctx, json->source.index,
+                     json->source.index_size * sizeof(*json->source.index));
+    json->alloc.free(json->alloc.ctx, json->source.block,
+                     json->source.block != NULL ? json->source.block_size : 0);
+    json->alloc.free(json->alloc.ctx, json->counts,
+                     json->counts_size * sizeof(*json->counts));
+
+    json_open_buffer(json, buffer, size);
+    json_set_streaming(json, false);
+    json->stack = stack;
+    json->stack_size = stack_size;
+    json->data.string = string;
+    json->data.string_size = string_size;
+}
+
+static size_t
+ndjson_start(const struct ndjson *nd, size_t chunk)
 {
-    json->alloc = *a;
+    size_t at = chunk * (size_t)PDJSON_NDJSON_CHUNK;
+    const char *nl;
+    if (chunk == 0)
+        return 0;
+    if (chunk >= nd->nchunks)
+        return nd->size;
+    nl = (const char *)memchr(nd->buffer + at - 1, '\n', nd->size - at + 1);
+    return nl != NULL ? (size_t)(nl - nd->buffer) + 1 : nd->size;
 }
 
-void json_set_streaming(json_stream *json, bool streaming)
+/* Call back on every line of a chunk that is not blank, keeping the
+   results in the slot given, if any. Returns -1 if that runs out of
+   memory. */
+static int
+ndjson_chunk(struct ndjson *nd, json_stream *json, size_t chunk,
+             struct ndjson_slot *slot)
 {
-    if (streaming)
-        json->flags |= JSON_FLAG_STREAMING;
+    const char *p = nd->buffer + ndjson_start(nd, chunk);
+    const char *end = nd->buffer + ndjson_start(nd, chunk + 1);
+
+    while (p < end) {
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        const char *eol = nl != NULL ? nl : end;
+        const char *q = p;
+        void *result;
+
+        while (q < eol && json_isspace((unsigned char)*q))
+            q++;
+        if (q < eol) {
+            reopen_buffer(json, p, eol - p);
+            result = nd->record(json, p - nd->buffer, nd->user);
+            if (slot != NULL) {
+                if (slot->count == slot->size) {
+                    size_t size = slot->size ? slot->size * 2 : 64;
+                    struct ndjson_result *results = (struct ndjson_result *)
+                        realloc(slot->results, size * sizeof(*results));
+                    if (results == NULL)
+                        return -1;
+                    slot->results = results;
+                    slot->size = size;
+                }
+                slot->results[slot->count].result = result;
+                slot->results[slot->count].offset = p - nd->buffer;
+                slot->count++;
+            }
+        }
+        p = eol + 1;
+    }
+    return 0;
+}
+
+static void
+ndjson_emit(struct ndjson *nd, struct ndjson_slot *slot)
+{
+    size_t i;
+    for (i = 0; i < slot->count; i++)
+        nd->result(slot->results[i].result, slot->results[i].offset, nd->user);
+    slot->count = 0;
+    slot->done = 0;
+}
+
+#ifndef _WIN32
+static void *
+ndjson_worker(void *arg)
+{
+    struct ndjson *nd = (struct ndjson *)arg;
+    json_stream json[1];
+
+    json_open_buffer(json, "", 0);
+    pthread_mutex_lock(&nd->lock);
+    while (!nd->failed && nd->next < nd->nchunks) {
+        size_t chunk = nd->next;
+        struct ndjson_slot *slot = NULL;
+        int r;
+
+        if (nd->slots != NULL) {
+            if (chunk >= nd->emitted + nd->nslots) {
+                pthread_cond_wait(&nd->cond, &nd->lock);
+                continue;
+            }
+            slot = &nd->slots[chunk % nd->nslots];
+        }
+        nd->next++;
+        pthread_mutex_unlock(&nd->lock);
+
+        r = ndjson_chunk(nd, json, chunk, slot);
+
+        pthread_mutex_lock(&nd->lock);
+        if (r != 0)
+            nd->failed = 1;
+        if (slot != NULL)
+            slot->done = 1;
+        pthread_cond_broadcast(&nd->cond);
+    }
+    pthread_mutex_unlock(&nd->lock);
+    json_close(json);
+    return NULL;
+}
+#endif
+
+/* Without threads, everything happens in turn on the calling thread. */
+static int
+ndjson_serial(struct ndjson *nd)
+{
+    json_stream json[1];
+    struct ndjson_slot slot = {NULL, 0, 0, 0};
+    size_t chunk;
+    int r = 0;
+
+    json_open_buffer(json, "", 0);
+    for (chunk = 0; r == 0 && chunk < nd->nchunks; chunk++) {
+        r = ndjson_chunk(nd, json, chunk, nd->result != NULL ? &slot : NULL);
+        if (r == 0 && nd->result != NULL)
+            ndjson_emit(nd, &slot);
+    }
+    free(slot.results);
+    json_close(json);
+    return r;
+}
+
+int json_parallel_ndjson(const void *buffer, size_t size, unsigned threads,
+                         json_ndjson_record record, json_ndjson_result result,
+                         void *user)
+{
+    struct ndjson nd[1];
+    int r = 0;
+
+    nd->buffer = (const char *)buffer;
+    nd->size = size;
+    nd->record = record;
+    nd->result = result;
+    nd->user = user;
+    nd->nchunks = size / PDJSON_NDJSON_CHUNK + (size % PDJSON_NDJSON_CHUNK != 0);
+    nd->next = 0;
+    nd->emitted = 0;
+    nd->nslots = 0;
+    nd->slots = NULL;
+    nd->failed = 0;
+
+#ifdef _WIN32
+    (void)threads;
+    return ndjson_serial(nd);
+#else
+    if (threads == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (unsigned)n : 1;
+#else
+        threads = 1;
+#endif
+    }
+    if (threads > nd->nchunks)
+        threads = (unsigned)nd->nchunks;
+    if (threads <= 1)
+        return ndjson_serial(nd);
+
+    if (result != NULL) {
+        nd->nslots = 4 * (size_t)threads;
+        nd->slots = (struct ndjson_slot *)calloc(nd->nslots, sizeof(*nd->slots));
+        if (nd->slots == NULL)
+            return -1;
+    }
+
+    {
+        pthread_t *workers = (pthread_t *)malloc(threads * sizeof(*workers));
+        unsigned i, started = 0;
+
+        if (workers == NULL) {
+            free(nd->slots);
+            return -1;
+        }
+        pthread_mutex_init(&nd->lock, NULL);
+        pthread_cond_init(&nd->cond, NULL);
+        for (i = 0; i < threads; i++)
+            if (pthread_create(&workers[started], NULL, ndjson_worker, nd) == 0)
+                started++;
+
+        if (started == 0) {
+            r = ndjson_serial(nd);
+        } else if (result != NULL) {
+            /* Pass on each chunk's results once it is done, in order */
+            pthread_mutex_lock(&nd->lock);
+            while (!nd->failed && nd->emitted < nd->nchunks) {
+                struct ndjson_slot *slot = &nd->slots[nd->emitted % nd->nslots];
+                if (!slot->done) {
+                    pthread_cond_wait(&nd->cond, &nd->lock);
+                    continue;
+                }
+                pthread_mutex_unlock(&nd->lock);
+                ndjson_emit(nd, slot);
+                pthread_mutex_lock(&nd->lock);
+                nd->emitted++;
+                pthread_cond_broadcast(&nd->cond);
+            }
+            pthread_mutex_unlock(&nd->lock);
+        }
+
+        for (i = 0; i < started; i++)
+            pthread_join(workers[i], NULL);
+        if (nd->failed)
+            r = -1;
+        pthread_cond_destroy(&nd->cond);
+        pthread_mutex_destroy(&nd->lock);
+        free(workers);
+    }
+
+    if (nd->slots != NULL) {
+        size_t i;
+        for (i = 0; i < nd->nslots; i++)
+            free(nd->slots[i].results);
+        free(nd->slots);
+    }
+    return r;
+#endif
+}
+
+/* Writer */
+
+#define WRITER_ERROR (1u << 0)
+#define WRITER_OWNED (1u << 1)
+#define WRITER_GROW  (1u << 2)
+#define WRITER_FIRST (1u << 3)  /* nothing written yet at this depth */
+#define WRITER_KEY   (1u << 4)  /* a key is waiting for its value */
+
+/* Like the parser, the writer keeps a bit for each open container, set
+   for an object, so that keys and ends can be checked against it. */
+static int
+writer_in_object(const json_writer *w)
+{
+    size_t level = w->depth - 1;
+    return w->depth > 0 && (w->stack[level / 8] >> level % 8 & 1);
+}
+
+static void
+writer_init(json_writer *w, char *buffer, size_t size, json_writer_sink sink, void *user)
+{
+    w->buffer = buffer;
+    w->fill = 0;
+    w->size = size;
+    w->sink = sink;
+    w->user = user;
+    w->fd = -1;
+    w->depth = 0;
+    w->stack = NULL;
+    w->stack_size = 0;
+    w->indent = 0;
+    w->flags = WRITER_FIRST;
+    if (buffer == NULL) {
+        w->buffer = (char *)malloc(size);
+        w->flags |= w->buffer != NULL ? WRITER_OWNED : WRITER_ERROR;
+    }
+}
+
+static int
+fd_sink(const char *data, size_t size, void *user)
+{
+    int fd = *(int *)user;
+    while (size > 0) {
+        long n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int
+stream_sink(const char *data, size_t size, void *user)
+{
+    return fwrite(data, 1, size, (FILE *)user) == size ? 0 : -1;
+}
+
+void json_writer_open_buffer(json_writer *w)
+{
+    writer_init(w, NULL, 4096, NULL, NULL);
+    w->flags |= WRITER_GROW;
+}
+
+void json_writer_open_user(json_writer *w, void *buffer, size_t size,
+                           json_writer_sink sink, void *user)
+{
+    if (size == 0)
+        buffer = NULL; /* nothing would ever fit */
+    writer_init(w, (char *)buffer, buffer != NULL ? size : PDJSON_BUFFER_SIZE, sink, user);
+}
+
+void json_writer_open_fd(json_writer *w, int fd)
+{
+    writer_init(w, NULL, PDJSON_BUFFER_SIZE, fd_sink, NULL);
+    w->fd = fd;
+    w->user = &w->fd;
+}
+
+void json_writer_open_stream(json_writer *w, FILE *stream)
+{
+    writer_init(w, NULL, PDJSON_BUFFER_SIZE, stream_sink, stream);
+}
+
+void json_writer_set_indent(json_writer *w, unsigned indent)
+{
+    w->indent = indent;
+}
+
+int json_writer_flush(json_writer *w)
+{
+    if (w->flags & WRITER_ERROR)
+        return -1;
+    if (w->fill > 0 && !(w->flags & WRITER_GROW)) {
+        if (w->sink == NULL || w->sink(w->buffer, w->fill, w->user) != 0) {
+            w->flags |= WRITER_ERROR;
+            return -1;
+        }
+        w->fill = 0;
+    }
+    return 0;
+}
+
+int json_writer_close(json_writer *w)
+{
+    int r = json_writer_flush(w);
+    if (w->flags & WRITER_OWNED)
+        free(w->buffer);
+    free(w->stack);
+    w->buffer = NULL;
+    w->stack = NULL;
+    w->fill = w->size = 0;
+    w->stack_size = 0;
+    return r;
+}
+
+/* Make room for at least n more bytes, by growing the buffer or else by
+   passing its contents on. */
+static int
+writer_room(json_writer *w, size_t n)
+{
+    if (w->flags & WRITER_GROW) {
+        size_t size = w->size;
+        char *buffer;
+        while (size - w->fill < n) {
+            if (size > SIZE_MAX / 2)
+                goto fail;
+            size *= 2;
+        }
+        buffer = (char *)realloc(w->buffer, size);
+        if (buffer == NULL)
+            goto fail;
+        w->buffer = buffer;
+        w->size = size;
+        return 0;
+    }
+    return json_writer_flush(w);
+
+fail:
+    w->flags |= WRITER_ERROR;
+    return -1;
+}
+
+static int
+writer_put(json_writer *w, const void *data, size_t n)
+{
+    const char *p = (const char *)data;
+    while (n > w->size - w->fill) {
+        size_t room = w->size - w->fill;
+        if (!(w->flags & WRITER_GROW)) {
+            memcpy(w->buffer + w->fill, p, room);
+            w->fill += room;
+            p += room;
+            n -= room;
+        }
+        if (writer_room(w, n) != 0)
+            return -1;
+    }
+    memcpy(w->buffer + w->fill, p, n);
+    w->fill += n;
+    return 0;
+}
+
+static int
+writer_byte(json_writer *w, char c)
+{
+    if (w->fill == w->size && writer_room(w, 1) != 0)
+        return -1;
+    w->buffer[w->fill++] = c;
+    return 0;
+}
+
+static int
+writer_newline(json_writer *w, size_t depth)
+{
+    static const char spaces[] = "                                ";
+    size_t n = depth * w->indent;
+    if (writer_byte(w, '\n') != 0)
+        return -1;
+    for (; n > sizeof(spaces) - 1; n -= sizeof(spaces) - 1)
+        if (writer_put(w, spaces, sizeof(spaces) - 1) != 0)
+            return -1;
+    return writer_put(w, spaces, n);
+}
+
+/* Whatever has to come between the last thing written and the next
+   value, or key: nothing after a key, a comma within a container (and,
+   when indenting, a new line), and a new line between top-level values.
+   A key belongs only in an object and not after another key, and a value
+   in an object only after a key. */
+static int
+writer_separate(json_writer *w, int key)
+{
+    unsigned flags = w->flags;
+    if (flags & WRITER_ERROR)
+        return -1;
+    if (key ? !writer_in_object(w) || (flags & WRITER_KEY)
+            : writer_in_object(w) && !(flags & WRITER_KEY)) {
+        w->flags |= WRITER_ERROR;
+        return -1;
+    }
+    w->flags &= ~(WRITER_FIRST | WRITER_KEY);
+    if (flags & WRITER_KEY)
+        return 0;
+    if (w->depth == 0)
+        return flags & WRITER_FIRST ? 0 : writer_byte(w, '\n');
+    if (!(flags & WRITER_FIRST) && writer_byte(w, ',') != 0)
+        return -1;
+    return w->indent ? writer_newline(w, w->depth) : 0;
+}
+
+static int
+writer_begin(json_writer *w, char c)
+{
+    size_t level = w->depth;
+    if (writer_separate(w, 0) != 0 || writer_byte(w, c) != 0)
+        return -1;
+    if (level / 8 >= w->stack_size) {
+        size_t size = w->stack_size > 0 ? w->stack_size * 2 : 8;
+        unsigned char *stack = (unsigned char *)realloc(w->stack, size);
+        if (stack == NULL) {
+            w->flags |= WRITER_ERROR;
+            return -1;
+        }
+        w->stack = stack;
+        w->stack_size = size;
+    }
+    if (c == '{')
+        w->stack[level / 8] |= 1u << level % 8;
     else
-        json->flags &= ~JSON_FLAG_STREAMING;
+        w->stack[level / 8] &= ~(1u << level % 8);
+    w->depth++;
+    w->flags |= WRITER_FIRST;
+    return 0;
 }
 
-void json_close(json_stream *json)
+static int
+writer_end(json_writer *w, char c)
+{
+    if (w->flags & WRITER_ERROR)
+        return -1;
+    if (w->depth == 0 || (w->flags & WRITER_KEY) ||
+        writer_in_object(w) != (c == '}')) {
+        w->flags |= WRITER_ERROR;
+        return -1;
+    }
+    w->depth--;
+    if (w->indent && !(w->flags & WRITER_FIRST) && writer_newline(w, w->depth) != 0)
+        return -1;
+    w->flags &= ~WRITER_FIRST;
+    return writer_byte(w, c);
+}
+
+/* Copy the string a run at a time, as found by the lexer's own scanner,
+   escaping what stops each run. */
+static int
+writer_string(json_writer *w, const char *string, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *)string;
+    const unsigned char *end = p + length;
+
+    if (writer_byte(w, '"') != 0)
+        return -1;
+    while (p < end) {
+        const unsigned char *stop = scan_string(p, end, 1);
+        char escape[6] = {'\\', 0, '0', '0', 0, 0};
+        size_t n = 2;
+        if (writer_put(w, p, stop - p) != 0)
+            return -1;
+        if (stop == end)
+            break;
+        switch (*stop) {
+        case '"':  escape[1] = '"';  break;
+        case '\\': escape[1] = '\\'; break;
+        case '\b': escape[1] = 'b';  break;
+        case '\f': escape[1] = 'f';  break;
+        case '\n': escape[1] = 'n';  break;
+        case '\r': escape[1] = 'r';  break;
+        case '\t': escape[1] = 't';  break;
+        default:
+            escape[1] = 'u';
+            escape[4] = hex[*stop >> 4];
+            escape[5] = hex[*stop & 0xf];
+            n = 6;
+        }
+        if (writer_put(w, escape, n) != 0)
+            return -1;
+        p = stop + 1;
+    }
+    return writer_byte(w, '"');
+}
+
+int json_write_begin_object(json_writer *w)
+{
+    return writer_begin(w, '{');
+}
+
+int json_write_end_object(json_writer *w)
+{
+    return writer_end(w, '}');
+}
+
+int json_write_begin_array(json_writer *w)
+{
+    return writer_begin(w, '[');
+}
+
+int json_write_end_array(json_writer *w)
+{
+    return writer_end(w, ']');
+}
+
+int json_write_key(json_writer *w, const char *key, size_t length)
+{
+    if (writer_separate(w, 1) != 0 || writer_string(w, key, length) != 0 ||
+        writer_byte(w, ':') != 0 || (w->indent && writer_byte(w, ' ') != 0))
+        return -1;
+    w->flags |= WRITER_KEY;
+    return 0;
+}
+
+int json_write_string(json_writer *w, const char *string, size_t length)
+{
+    if (writer_separate(w, 0) != 0)
+        return -1;
+    return writer_string(w, string, length);
+}
+
+int json_write_raw(json_writer *w, const char *text, size_t length)
+{
+    if (writer_separate(w, 0) != 0)
+        return -1;
+    return writer_put(w, text, length);
+}
+
+int json_write_int(json_writer *w, int64_t value)
+{
+    char text[24];
+    char *p = text + sizeof(text);
+    uint64_t u = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    do
+        *--p = '0' + u % 10;
+    while ((u /= 10) != 0);
+    if (value < 0)
+        *--p = '-';
+    return json_write_raw(w, p, text + sizeof(text) - p);
+}
+
+/* Doubles are written with the fewest significant digits that read back
+   as the same value, found by Schubfach (R. Giulietti, "The Schubfach way
+   to render doubles"). The value and the two bounds of the interval that
+   reads back as it are each scaled by one power of ten from the lexer's
+   table, the products rounded to odd, which is enough to tell whether
+   one digit fewer than the scaled value has can still land inside the
+   interval. Otherwise the nearer of the two candidates either side of
+   the scaled value that does is taken. The digits are then laid out as
+   JavaScript lays them out, with an exponent only below 1e-6 or from
+   1e21 up, so neither printf() nor the locale has a say.
+ */
+
+/* floor(a / 2^n), without shifting negative values */
+static long
+floor_shift(long a, int n)
 {
-    json->alloc.free(json->stack);
-    json->alloc.free(json->data.string);
+    return a >= 0 ? a >> n : -((-a + (1L << n) - 1) >> n);
+}
+
+/* The high 64 bits of the 192-bit product g * cp, with the lowest set
+   should any of the bits below them be. */
+static uint64_t
+round_to_odd(uint64_t g1, uint64_t g0, uint64_t cp)
+{
+    uint64_t xlo, ylo;
+    uint64_t xhi = mul128(g0, cp, &xlo);
+    uint64_t yhi = mul128(g1, cp, &ylo);
+    uint64_t y0 = ylo + xhi;
+    uint64_t y1 = yhi + (y0 < ylo);
+    (void)xlo;
+    return y1 | (y0 > 1);
+}
+
+/* The shortest decimal m * 10^e reading back as the positive, finite,
+   non-zero double with the given bits. */
+static uint64_t
+shortest_decimal(uint64_t bits, int *e)
+{
+    uint64_t f = bits & 0x000fffffffffffff;
+    int biased = (int)(bits >> 52 & 0x7ff);
+    uint64_t c = biased ? f | (uint64_t)1 << 52 : f;
+    int q = biased ? biased - 1075 : -1074;
+    int even = !(c & 1);
+    int closer = f == 0 && biased > 1;  /* the lower bound is nearer */
+    int k = (int)floor_shift(q * 1262611L - (closer ? 524031L : 0), 22);
+    int h = q + (int)floor_shift(-k * 1741647L, 19) + 1;
+    const uint64_t *pow10 = pow10_table[-k - POW10_MIN];
+    uint64_t g1 = pow10[0], g0 = pow10[1] + 1;
+    uint64_t vbl, vb, vbr, lower, upper, s;
+    int u, w;
+
+    if (g0 == 0)
+        g1++;
+    vbl = round_to_odd(g1, g0, (4 * c - 2 + closer) << h);
+    vb = round_to_odd(g1, g0, 4 * c << h);
+    vbr = round_to_odd(g1, g0, (4 * c + 2) << h);
+    lower = vbl + !even;
+    upper = vbr - !even;
+
+    s = vb / 4;
+    if (s >= 10) {
+        uint64_t sp = s / 10;
+        u = lower <= 40 * sp;
+        w = 40 * sp + 40 <= upper;
+        if (u != w) {
+            *e = k + 1;
+            return sp + w;
+        }
+    }
+    u = lower <= 4 * s;
+    w = 4 * s + 4 <= upper;
+    *e = k;
+    if (u != w)
+        return s + w;
+    return s + (vb > 4 * s + 2 || (vb == 4 * s + 2 && (s & 1)));
+}
+
+int json_write_number(json_writer *w, double value)
+{
+    char digits[20], text[32];
+    uint64_t bits, m;
+    int e, ndigits = 0, point, n = 0, i;
+
+    if (isnan(value) || isinf(value)) {
+        w->flags |= WRITER_ERROR;
+        return -1;
+    }
+    if (value > -9007199254740992.0 && value < 9007199254740992.0 &&
+        value == (double)(int64_t)value && !(value == 0 && signbit(value)))
+        return json_write_int(w, (int64_t)value);
+    if (value == 0)  /* the positive zero went above */
+        return json_write_raw(w, "-0", 2);
+
+    memcpy(&bits, &value, sizeof(bits));
+    m = shortest_decimal(bits & 0x7fffffffffffffff, &e);
+    for (; m % 10 == 0; m /= 10)
+        e++;
+    for (; m != 0; m /= 10)
+        digits[sizeof(digits) - ++ndigits] = (char)('0' + m % 10);
+    memmove(digits, digits + sizeof(digits) - ndigits, ndigits);
+    point = ndigits + e;  /* the value is 0.digits * 10^point */
+
+    if (bits >> 63)
+        text[n++] = '-';
+    if (point >= ndigits && point <= 21) {
+        memcpy(text + n, digits, ndigits);
+        n += ndigits;
+        for (i = ndigits; i < point; i++)
+            text[n++] = '0';
+    } else if (point > 0 && point <= 21) {
+        memcpy(text + n, digits, point);
+        n += point;
+        text[n++] = '.';
+        memcpy(text + n, digits + point, ndigits - point);
+        n += ndigits - point;
+    } else if (point > -6 && point <= 0) {
+        text[n++] = '0';
+        text[n++] = '.';
+        for (i = point; i < 0; i++)
+            text[n++] = '0';
+        memcpy(text + n, digits, ndigits);
+        n += ndigits;
+    } else {
+        text[n++] = digits[0];
+        if (ndigits > 1) {
+            text[n++] = '.';
+            memcpy(text + n, digits + 1, ndigits - 1);
+            n += ndigits - 1;
+        }
+        e = point - 1;
+        text[n++] = 'e';
+        text[n++] = e < 0 ? '-' : '+';
+        e = e < 0 ? -e : e;
+        if (e >= 100)
+            text[n++] = (char)('0' + e / 100);
+        if (e >= 10)
+            text[n++] = (char)('0' + e / 10 % 10);
+        text[n++] = (char)('0' + e % 10);
+    }
+    return json_write_raw(w, text, n);
+}
+
+int json_write_bool(json_writer *w, bool value)
+{
+    return value ? json_write_raw(w, "true", 4) : json_write_raw(w, "false", 5);
+}
+
+int json_write_null(json_writer *w)
+{
+    return json_write_raw(w, "null", 4);
+}
+
+const char *json_writer_get_buffer(json_writer *w, size_t *length)
+{
+    if (length != NULL)
+        *length = w->fill;
+    if (w->buffer == NULL)
+        return "";
+    /* A growable buffer is also terminated, when there is room */
+    if ((w->flags & WRITER_GROW) && w->fill < w->size)
+        w->buffer[w->fill] = '\0';
+    return w->buffer;
 }
@@ -20,11 +20,22 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include <stdio.h>
+#include <stdint.h>
 
 enum json_type {
     JSON_ERROR = 1, JSON_DONE,
     JSON_OBJECT, JSON_OBJECT_END, JSON_ARRAY, JSON_ARRAY_END,
-    JSON_STRING, JSON_NUMBER, JSON_TRUE, JSON_FALSE, JSON_NULL
+    JSON_STRING, JSON_NUMBER, JSON_TRUE, JSON_FALSE, JSON_NULL,
+    JSON_INCOMPLETE, JSON_STRING_PART
+};
+
+/* One event from json_next_batch(): its depth is json_get_depth() just
+   after it, and strings and numbers have their text. */
+struct json_token {
+    enum json_type type;
+    size_t depth;
+    const char *text;
+    size_t length;
 };
 
 struct json_allocator {
@@ -33,28 +44,117 @@ struct json_allocator {
     void (*free)(void *);
 };
 
+/* Allocators with a context, which every call is given, along with the
+   size of a block being resized or freed. */
+struct json_context_allocator {
+    void *(*malloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+};
+
 typedef int (*json_user_io)(void *user);
+typedef long (*json_user_read)(void *user, void *buffer, size_t size);
 
 typedef struct json_stream json_stream;
 typedef struct json_allocator json_allocator;
+typedef struct json_context_allocator json_context_allocator;
+typedef struct json_arena json_arena;
+typedef struct json_tape json_tape;
+typedef struct json_writer json_writer;
+typedef struct json_token json_token;
+typedef struct json_extractor json_extractor;
+typedef struct json_keyset json_keyset;
+
+typedef void *(*json_ndjson_record)(json_stream *json, size_t offset, void *user);
+typedef void (*json_ndjson_result)(void *result, size_t offset, void *user);
+typedef int (*json_writer_sink)(const char *data, size_t size, void *user);
+typedef void (*json_extract_match)(json_stream *json, size_t path, enum json_type type, void *user);
 
 PDJSON_SYMEXPORT void json_open_buffer(json_stream *json, const void *buffer, size_t size);
 PDJSON_SYMEXPORT void json_open_string(json_stream *json, const char *string);
 PDJSON_SYMEXPORT void json_open_stream(json_stream *json, FILE *stream);
+PDJSON_SYMEXPORT void json_open_fd(json_stream *json, int fd);
+PDJSON_SYMEXPORT int json_open_file(json_stream *json, const char *path);
 PDJSON_SYMEXPORT void json_open_user(json_stream *json, json_user_io get, json_user_io peek, void *user);
+PDJSON_SYMEXPORT void json_open_reader(json_stream *json, json_user_read read, void *user);
+PDJSON_SYMEXPORT void json_open_feed(json_stream *json);
+PDJSON_SYMEXPORT int json_feed(json_stream *json, const void *data, size_t size);
 PDJSON_SYMEXPORT void json_close(json_stream *json);
 
 PDJSON_SYMEXPORT void json_set_allocator(json_stream *json, json_allocator *a);
+PDJSON_SYMEXPORT void json_set_context_allocator(json_stream *json, const json_context_allocator *a);
+PDJSON_SYMEXPORT void json_set_arena(json_stream *json, json_arena *arena);
+PDJSON_SYMEXPORT void json_set_storage(json_stream *json, void *stack, size_t stack_size,
+                                       void *string, size_t string_size);
+PDJSON_SYMEXPORT void json_set_counts(json_stream *json, bool counts);
+PDJSON_SYMEXPORT void json_set_string_parts(json_stream *json, size_t size);
 PDJSON_SYMEXPORT void json_set_streaming(json_stream *json, bool mode);
+PDJSON_SYMEXPORT void json_set_raw_skip(json_stream *json, bool raw);
+PDJSON_SYMEXPORT void json_set_buffer_size(json_stream *json, size_t size);
+PDJSON_SYMEXPORT bool json_validate_utf8(json_stream *json);
+PDJSON_SYMEXPORT bool json_build_index(json_stream *json);
 
 PDJSON_SYMEXPORT enum json_type json_next(json_stream *json);
 PDJSON_SYMEXPORT enum json_type json_peek(json_stream *json);
 PDJSON_SYMEXPORT void json_reset(json_stream *json);
 PDJSON_SYMEXPORT const char *json_get_string(json_stream *json, size_t *length);
+PDJSON_SYMEXPORT bool json_get_slice(json_stream *json, const char **ptr, size_t *length);
+PDJSON_SYMEXPORT uint64_t json_get_string_hash(json_stream *json);
 PDJSON_SYMEXPORT double json_get_number(json_stream *json);
+PDJSON_SYMEXPORT bool json_get_int64(json_stream *json, int64_t *value);
+PDJSON_SYMEXPORT bool json_get_uint64(json_stream *json, uint64_t *value);
+PDJSON_SYMEXPORT bool json_get_decimal(json_stream *json, int64_t *mantissa, long *exponent);
+
+PDJSON_SYMEXPORT void json_arena_init(json_arena *arena, void *buffer, size_t size);
+PDJSON_SYMEXPORT void json_arena_release(json_arena *arena);
+
+PDJSON_SYMEXPORT size_t json_next_batch(json_stream *json, json_token *tokens, size_t n,
+                                        json_arena *arena);
+PDJSON_SYMEXPORT const json_tape *json_parse_tape(json_stream *json, json_arena *arena);
+PDJSON_SYMEXPORT enum json_type json_tape_type(const json_tape *tape, size_t i);
+PDJSON_SYMEXPORT size_t json_tape_next(const json_tape *tape, size_t i);
+PDJSON_SYMEXPORT const char *json_tape_string(const json_tape *tape, size_t i, size_t *length);
+PDJSON_SYMEXPORT double json_tape_number(const json_tape *tape, size_t i);
+PDJSON_SYMEXPORT bool json_tape_int64(const json_tape *tape, size_t i, int64_t *value);
+PDJSON_SYMEXPORT size_t json_tape_member(const json_tape *tape, size_t object, const char *name);
+
+PDJSON_SYMEXPORT int json_parallel_ndjson(const void *buffer, size_t size, unsigned threads,
+                                          json_ndjson_record record, json_ndjson_result result,
+                                          void *user);
 
 PDJSON_SYMEXPORT enum json_type json_skip(json_stream *json);
 PDJSON_SYMEXPORT enum json_type json_skip_until(json_stream *json, enum json_type type);
+PDJSON_SYMEXPORT enum json_type json_find(json_stream *json, const char *pointer);
+PDJSON_SYMEXPORT json_extractor *json_extractor_compile(const char *const *paths, size_t n);
+PDJSON_SYMEXPORT void json_extractor_free(json_extractor *ex);
+PDJSON_SYMEXPORT enum json_type json_extract(json_stream *json, const json_extractor *ex,
+                                             json_extract_match match, void *user);
+PDJSON_SYMEXPORT json_keyset *json_keyset_compile(const char *const *keys, size_t n);
+PDJSON_SYMEXPORT void json_keyset_free(json_keyset *ks);
+PDJSON_SYMEXPORT size_t json_keyset_lookup(const json_keyset *ks, json_stream *json);
+
+PDJSON_SYMEXPORT void json_writer_open_buffer(json_writer *w);
+PDJSON_SYMEXPORT void json_writer_open_user(json_writer *w, void *buffer, size_t size,
+                                            json_writer_sink sink, void *user);
+PDJSON_SYMEXPORT void json_writer_open_fd(json_writer *w, int fd);
+PDJSON_SYMEXPORT void json_writer_open_stream(json_writer *w, FILE *stream);
+PDJSON_SYMEXPORT void json_writer_set_indent(json_writer *w, unsigned indent);
+PDJSON_SYMEXPORT const char *json_writer_get_buffer(json_writer *w, size_t *length);
+PDJSON_SYMEXPORT int json_writer_flush(json_writer *w);
+PDJSON_SYMEXPORT int json_writer_close(json_writer *w);
+
+PDJSON_SYMEXPORT int json_write_begin_object(json_writer *w);
+PDJSON_SYMEXPORT int json_write_end_object(json_writer *w);
+PDJSON_SYMEXPORT int json_write_begin_array(json_writer *w);
+PDJSON_SYMEXPORT int json_write_end_array(json_writer *w);
+PDJSON_SYMEXPORT int json_write_key(json_writer *w, const char *key, size_t length);
+PDJSON_SYMEXPORT int json_write_string(json_writer *w, const char *string, size_t length);
+PDJSON_SYMEXPORT int json_write_number(json_writer *w, double value);
+PDJSON_SYMEXPORT int json_write_int(json_writer *w, int64_t value);
+PDJSON_SYMEXPORT int json_write_bool(json_writer *w, bool value);
+PDJSON_SYMEXPORT int json_write_null(json_writer *w);
+PDJSON_SYMEXPORT int json_write_raw(json_writer *w, const char *text, size_t length);
 
 PDJSON_SYMEXPORT size_t json_get_lineno(json_stream *json);
 PDJSON_SYMEXPORT size_t json_get_position(json_stream *json);
@@ -66,16 +166,33 @@ PDJSON_SYMEXPORT int json_source_get(json_stream *json);
 PDJSON_SYMEXPORT int json_source_peek(json_stream *json);
 PDJSON_SYMEXPORT bool json_isspace(int c);
 
+/* Bytes of stack storage for json_set_storage() to nest depth deep. */
+#define JSON_STACK_SIZE(depth) (((depth) + 1) / 2)
+
 /* internal */
 
 struct json_source {
     int (*get)(struct json_source *);
     int (*peek)(struct json_source *);
     size_t position;
+    const unsigned char *base;
+    const unsigned char *cursor;
+    const unsigned char *limit;
+    const unsigned char *counted;
+    const unsigned char *mark;
+    unsigned char *block;
+    size_t block_size;
+    uint32_t *index;
+    size_t index_size;
+    size_t index_next;
     union {
         struct {
             FILE *stream;
+            int regular;
         } stream;
+        struct {
+            int fd;
+        } fd;
         struct {
             const char *buffer;
             size_t length;
@@ -85,15 +202,24 @@ struct json_source {
             json_user_io get;
             json_user_io peek;
         } user;
+        struct {
+            void *ptr;
+            json_user_read read;
+        } reader;
+        struct {
+            size_t wait;
+        } feed;
     } source;
 };
 
 struct json_stream {
     size_t lineno;
 
-    struct json_stack *stack;
+    unsigned char *stack;
     size_t stack_top;
     size_t stack_size;
+    size_t *counts;
+    size_t counts_size;
     enum json_type next;
     unsigned flags;
 
@@ -101,15 +227,57 @@ struct json_stream {
         char *string;
         size_t string_fill;
         size_t string_size;
+        const char *slice;
+        size_t slice_length;
+        size_t part_size;
+        struct json_number {
+            uint64_t mantissa;
+            long exponent;
+            unsigned flags;
+        } number;
     } data;
 
     size_t ntokens;
+    size_t skip_depth;
+    enum json_type skip_type;
 
     struct json_source source;
-    struct json_allocator alloc;
+    struct json_context_allocator alloc;
+    struct json_allocator plain;
     char errmsg[128];
 };
 
+struct json_arena {
+    unsigned char *cursor;
+    unsigned char *limit;
+    unsigned char *last;
+    struct json_arena_chunk *chunks;
+    size_t chunk_size;
+    unsigned char *buffer;
+    size_t size;
+};
+
+struct json_writer {
+    char *buffer;
+    size_t fill;
+    size_t size;
+    json_writer_sink sink;
+    void *user;
+    int fd;
+    size_t depth;
+    unsigned char *stack;
+    size_t stack_size;
+    unsigned indent;
+    unsigned flags;
+};
+
+struct json_tape {
+    const uint64_t *words;
+    size_t size;
+    const char *strings;
+    size_t strings_size;
+};
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
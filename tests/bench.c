@@ -0,0 +1,408 @@
+/* This tool measures parsing throughput over synthetic corpora, which
+ * are generated from a fixed seed so that runs can be compared across
+ * builds. Each measurement is printed as a tab-separated line:
+ *
+ *     tests/bench [megabytes per corpus] [repeats]
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../pdjson.h"
+
+/* xorshift64*, so that every platform generates the same corpora */
+static uint64_t rng_state = UINT64_C(0x9E3779B97F4A7C15);
+
+static uint64_t
+rng(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static unsigned
+rng_below(unsigned n)
+{
+    return (unsigned)(rng() >> 32) % n;
+}
+
+static double
+rng_double(double lo, double hi)
+{
+    return lo + (hi - lo) * (double)(rng() >> 11) / (double)(UINT64_C(1) << 53);
+}
+
+static size_t
+written(json_writer *w)
+{
+    size_t length;
+    json_writer_get_buffer(w, &length);
+    return length;
+}
+
+static void
+write_word(json_writer *w, size_t min, size_t max, const char *alphabet)
+{
+    char word[256];
+    size_t n = min + rng_below((unsigned)(max - min + 1));
+    size_t k = strlen(alphabet);
+    for (size_t i = 0; i < n; i++)
+        word[i] = alphabet[rng_below((unsigned)k)];
+    json_write_string(w, word, n);
+}
+
+static const char lower[] = "abcdefghijklmnopqrstuvwxyz";
+static const char prose[] = "abcdefghijklmnopqrstuvwxyz      ,.ABCDEFGHIJ0123456789";
+
+/* A record of mixed values, as an API might return. */
+static void
+write_record(json_writer *w, unsigned long id)
+{
+    json_write_begin_object(w);
+    json_write_key(w, "id", 2);
+    json_write_int(w, (int64_t)id);
+    json_write_key(w, "name", 4);
+    write_word(w, 4, 16, lower);
+    json_write_key(w, "active", 6);
+    json_write_bool(w, rng_below(2));
+    json_write_key(w, "score", 5);
+    json_write_number(w, rng_double(0, 100));
+    json_write_key(w, "tags", 4);
+    json_write_begin_array(w);
+    for (unsigned i = rng_below(5); i > 0; i--)
+        write_word(w, 3, 8, lower);
+    json_write_end_array(w);
+    json_write_key(w, "owner", 5);
+    if (rng_below(4) == 0) {
+        json_write_null(w);
+    } else {
+        json_write_begin_object(w);
+        json_write_key(w, "login", 5);
+        write_word(w, 3, 12, lower);
+        json_write_key(w, "karma", 5);
+        json_write_int(w, (int64_t)rng_below(100000) - 50000);
+        json_write_end_object(w);
+    }
+    json_write_end_object(w);
+}
+
+static void
+gen_strings(json_writer *w, size_t size)
+{
+    json_write_begin_array(w);
+    while (written(w) < size) {
+        json_write_begin_object(w);
+        json_write_key(w, "title", 5);
+        write_word(w, 10, 60, prose);
+        json_write_key(w, "body", 4);
+        write_word(w, 80, 250, prose);
+        json_write_key(w, "author", 6);
+        write_word(w, 4, 12, lower);
+        json_write_end_object(w);
+    }
+    json_write_end_array(w);
+}
+
+/* Polygons of coordinates, after the canada.json benchmark. */
+static void
+gen_numbers(json_writer *w, size_t size)
+{
+    json_write_begin_array(w);
+    while (written(w) < size) {
+        json_write_begin_object(w);
+        json_write_key(w, "type", 4);
+        json_write_string(w, "Polygon", 7);
+        json_write_key(w, "coordinates", 11);
+        json_write_begin_array(w);
+        for (unsigned i = 0; i < 256; i++) {
+            json_write_begin_array(w);
+            json_write_number(w, rng_double(-141, -52));
+            json_write_number(w, rng_double(41, 84));
+            json_write_end_array(w);
+        }
+        json_write_end_array(w);
+        json_write_end_object(w);
+    }
+    json_write_end_array(w);
+}
+
+static void
+gen_nested(json_writer *w, size_t size)
+{
+    json_write_begin_array(w);
+    while (written(w) < size) {
+        unsigned depth = 32 + rng_below(200);
+        for (unsigned i = 0; i < depth; i++) {
+            if (i % 2) {
+                json_write_begin_object(w);
+                json_write_key(w, "k", 1);
+            } else {
+                json_write_begin_array(w);
+            }
+        }
+        json_write_int(w, depth);
+        for (unsigned i = depth; i-- > 0;) {
+            if (i % 2)
+                json_write_end_object(w);
+            else
+                json_write_end_array(w);
+        }
+    }
+    json_write_end_array(w);
+}
+
+static void
+gen_escapes(json_writer *w, size_t size)
+{
+    static const char special[] = "\"\\/\b\f\n\r\t\x01\x1f";
+    json_write_begin_array(w);
+    while (written(w) < size) {
+        char text[128];
+        size_t n = 16 + rng_below(100);
+        for (size_t i = 0; i < n; i++)
+            text[i] = rng_below(3) ? special[rng_below(sizeof(special) - 1)]
+                                   : lower[rng_below(26)];
+        json_write_string(w, text, n);
+    }
+    json_write_end_array(w);
+}
+
+static void
+gen_cjk(json_writer *w, size_t size)
+{
+    json_write_begin_array(w);
+    while (written(w) < size) {
+        char text[3 * 64];
+        size_t n = 4 + rng_below(60), len = 0;
+        for (size_t i = 0; i < n; i++) {
+            unsigned c = 0x4e00 + rng_below(0x9fff - 0x4e00);
+            text[len++] = (char)(0xe0 | c >> 12);
+            text[len++] = (char)(0x80 | (c >> 6 & 0x3f));
+            text[len++] = (char)(0x80 | (c & 0x3f));
+        }
+        json_write_begin_object(w);
+        json_write_key(w, "text", 4);
+        json_write_string(w, text, len);
+        json_write_end_object(w);
+    }
+    json_write_end_array(w);
+}
+
+static void
+gen_ndjson(json_writer *w, size_t size)
+{
+    for (unsigned long id = 0; written(w) < size; id++)
+        write_record(w, id);
+}
+
+static void
+gen_records(json_writer *w, size_t size)
+{
+    json_write_begin_array(w);
+    for (unsigned long id = 0; written(w) < size; id++)
+        write_record(w, id);
+    json_write_end_array(w);
+}
+
+struct corpus {
+    const char *name;
+    void (*generate)(json_writer *, size_t);
+    unsigned indent;
+    char *data;
+    size_t size;
+};
+
+/* Allocator calls made by the parser. */
+static unsigned long allocations;
+
+static void *
+count_malloc(size_t size)
+{
+    allocations++;
+    return malloc(size);
+}
+
+static void *
+count_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return realloc(ptr, size);
+}
+
+struct memory {
+    const char *data;
+    size_t size;
+    size_t pos;
+};
+
+static int
+memory_peek(void *user)
+{
+    struct memory *m = (struct memory *)user;
+    return m->pos < m->size ? (unsigned char)m->data[m->pos] : EOF;
+}
+
+static int
+memory_get(void *user)
+{
+    struct memory *m = (struct memory *)user;
+    return m->pos < m->size ? (unsigned char)m->data[m->pos++] : EOF;
+}
+
+static long
+memory_read(void *user, void *buffer, size_t size)
+{
+    struct memory *m = (struct memory *)user;
+    size_t n = m->size - m->pos < size ? m->size - m->pos : size;
+    memcpy(buffer, m->data + m->pos, n);
+    m->pos += n;
+    return (long)n;
+}
+
+enum op { OP_NEXT, OP_SKIP, OP_NUMBER };
+enum source { SOURCE_BUFFER, SOURCE_FILE, SOURCE_USER, SOURCE_READER };
+
+static const char *const op_names[] = {"next", "skip", "number"};
+static const char *const source_names[] = {"buffer", "file", "user", "reader"};
+
+static double
+now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static volatile double sink;
+
+/* Read every value in the stream, as a stream of them. Returns the
+   number of events, or of values skipped. */
+static size_t
+drain(json_stream *json, enum op op)
+{
+    size_t tokens = 0;
+    double sum = 0;
+    for (;;) {
+        enum json_type type = op == OP_SKIP ? json_skip(json) : json_next(json);
+        if (type == JSON_ERROR) {
+            fprintf(stderr, "error: %zu: %s\n", json_get_lineno(json), json_get_error(json));
+            exit(EXIT_FAILURE);
+        } else if (type == JSON_DONE) {
+            json_reset(json);
+            if (json_peek(json) == JSON_DONE)
+                break;
+            continue;
+        }
+        if (op == OP_NUMBER && type == JSON_NUMBER)
+            sum += json_get_number(json);
+        tokens++;
+    }
+    sink = sum;
+    return tokens;
+}
+
+static void
+run(const struct corpus *c, enum op op, enum source source, FILE *file, int repeats)
+{
+    json_allocator alloc = {count_malloc, count_realloc, free};
+    double best = -1;
+    size_t tokens = 0;
+    unsigned long allocs = 0;
+
+    for (int r = 0; r < repeats; r++) {
+        struct memory m = {c->data, c->size, 0};
+        json_stream json[1];
+        double start = now(), elapsed;
+        switch (source) {
+        case SOURCE_BUFFER:
+            json_open_buffer(json, c->data, c->size);
+            break;
+        case SOURCE_FILE:
+            rewind(file);
+            json_open_stream(json, file);
+            break;
+        case SOURCE_USER:
+            json_open_user(json, memory_get, memory_peek, &m);
+            break;
+        case SOURCE_READER:
+            json_open_reader(json, memory_read, &m);
+            break;
+        }
+        allocations = 0;
+        json_set_allocator(json, &alloc);
+        tokens = drain(json, op);
+        json_close(json);
+        elapsed = now() - start;
+        allocs = allocations;
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+    if (best <= 0)
+        best = 1e-9;
+    printf("%s\t%s\t%s\t%zu\t%zu\t%lu\t%.6f\t%.1f\t%.2f\n",
+           c->name, op_names[op], source_names[source], c->size, tokens, allocs,
+           best, c->size / best / 1e6, tokens / best / 1e6);
+    fflush(stdout);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct corpus corpora[] = {
+        {"strings", gen_strings, 0},
+        {"numbers", gen_numbers, 0},
+        {"nested", gen_nested, 0},
+        {"escapes", gen_escapes, 0},
+        {"cjk", gen_cjk, 0},
+        {"ndjson", gen_ndjson, 0},
+        {"minified", gen_records, 0},
+        {"pretty", gen_records, 2},
+    };
+    size_t megabytes = argc > 1 ? strtoul(argv[1], 0, 10) : 8;
+    int repeats = argc > 2 ? atoi(argv[2]) : 3;
+
+    if (megabytes == 0 || repeats <= 0) {
+        fprintf(stderr, "usage: %s [megabytes per corpus] [repeats]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    puts("corpus\top\tsource\tbytes\ttokens\tallocs\tseconds\tMB/s\tMtokens/s");
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(*corpora); i++) {
+        struct corpus *c = &corpora[i];
+        json_writer w;
+        FILE *file = tmpfile();
+        const char *data;
+
+        /* The same records, minified or pretty, come from the same seed */
+        rng_state = UINT64_C(0x9E3779B97F4A7C15);
+        json_writer_open_buffer(&w);
+        json_writer_set_indent(&w, c->indent);
+        c->generate(&w, megabytes << 20);
+        data = json_writer_get_buffer(&w, &c->size);
+        if (data == NULL || file == NULL) {
+            fprintf(stderr, "error: cannot generate %s\n", c->name);
+            return EXIT_FAILURE;
+        }
+        c->data = malloc(c->size);
+        memcpy(c->data, data, c->size);
+        json_writer_close(&w);
+        fwrite(c->data, 1, c->size, file);
+        fflush(file);
+
+        for (int s = SOURCE_BUFFER; s <= SOURCE_READER; s++)
+            run(c, OP_NEXT, (enum source)s, file, repeats);
+        run(c, OP_SKIP, SOURCE_BUFFER, file, repeats);
+        run(c, OP_NUMBER, SOURCE_BUFFER, file, repeats);
+
+        fclose(file);
+        free(c->data);
+    }
+    return 0;
+}
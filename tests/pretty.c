@@ -1,84 +1,69 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <errno.h>
 #include "../pdjson.h"
 
-void indent(int n)
-{
-    for (int i = 0; i < n * 2; i++)
-        putchar(' ');
-}
-
-void pretty(json_stream *json);
+void pretty(json_stream *json, json_writer *out);
 
-void pretty_array(json_stream *json)
+void pretty_array(json_stream *json, json_writer *out)
 {
-    printf("[\n");
-    int first = 1;
-    while (json_peek(json) != JSON_ARRAY_END && !json_get_error(json)) {
-        if (!first)
-            printf(",\n");
-        else
-            first = 0;
-        indent(json_get_depth(json));
-        pretty(json);
-    }
+    json_write_begin_array(out);
+    while (json_peek(json) != JSON_ARRAY_END && !json_get_error(json))
+        pretty(json, out);
     json_next(json);
-    printf("\n");
-    indent(json_get_depth(json));
-    printf("]");
+    json_write_end_array(out);
 }
 
-void pretty_object(json_stream *json)
+void pretty_object(json_stream *json, json_writer *out)
 {
-    printf("{\n");
-    int first = 1;
+    json_write_begin_object(out);
     while (json_peek(json) != JSON_OBJECT_END && !json_get_error(json)) {
-        if (!first)
-            printf(",\n");
-        else
-            first = 0;
-        indent(json_get_depth(json));
+        size_t length;
+        const char *key;
         json_next(json);
-        printf("\"%s\": ", json_get_string(json, NULL));
-        pretty(json);
+        key = json_get_string(json, &length);
+        json_write_key(out, key, length - 1);
+        pretty(json, out);
     }
     json_next(json);
-    printf("\n");
-    indent(json_get_depth(json));
-    printf("}");
+    json_write_end_object(out);
 }
 
-void pretty(json_stream *json)
+void pretty(json_stream *json, json_writer *out)
 {
     enum json_type type = json_next(json);
+    const char *s;
+    size_t length;
     switch (type) {
     case JSON_DONE:
         return;
     case JSON_NULL:
-        printf("null");
+        json_write_null(out);
         break;
     case JSON_TRUE:
-        printf("true");
+        json_write_bool(out, true);
         break;
     case JSON_FALSE:
-        printf("false");
-            break;
+        json_write_bool(out, false);
+        break;
     case JSON_NUMBER:
-        printf("%s", json_get_string(json, NULL));
+        /* as written in the input, to lose nothing */
+        s = json_get_string(json, &length);
+        json_write_raw(out, s, length - 1);
         break;
     case JSON_STRING:
-        printf("\"%s\"", json_get_string(json, NULL));
+        s = json_get_string(json, &length);
+        json_write_string(out, s, length - 1);
         break;
     case JSON_ARRAY:
-        pretty_array(json);
+        pretty_array(json, out);
         break;
     case JSON_OBJECT:
-        pretty_object(json);
+        pretty_object(json, out);
         break;
     case JSON_OBJECT_END:
     case JSON_ARRAY_END:
+    case JSON_INCOMPLETE:
+    case JSON_STRING_PART:
         return;
     case JSON_ERROR:
             fprintf(stderr, "error: %zu: %s\n",
@@ -88,54 +73,35 @@ void pretty(json_stream *json)
     }
 }
 
-long read_file(const char* fname, char** content)
-{
-    FILE *f = fopen(fname, "rb");
-    if (!f) goto err;
-    if (0 != fseek(f, 0, SEEK_END)) goto err;
-    long fsize = ftell(f);
-    if (fsize == -1L) goto err;
-    if (0 != fseek(f, 0, SEEK_SET)) goto err;
-    *content = malloc(fsize + 1);
-    fread(*content, fsize, 1, f);
-    if (ferror(f)) goto err;
-    fclose(f);
-    (*content)[fsize] = 0;
-    return fsize;
-
-err:
-    perror(strerror(errno));
-    return -1;
-}
-
 int main(int argc, char *argv[])
 {
     json_stream json;
-    char *jstr = NULL;
+    json_writer out;
 
     if (argc < 2) {
         json_open_stream(&json, stdin);
     }
-    else {
-
-        if (-1 == read_file(argv[1], &jstr)) {
-            free(jstr);
-            exit(EXIT_FAILURE);
-        }
-        json_open_string(&json, jstr);
+    else if (-1 == json_open_file(&json, argv[1])) {
+        fprintf(stderr, "error: %s\n", json_get_error(&json));
+        json_close(&json);
+        exit(EXIT_FAILURE);
     }
 
 	json_set_streaming(&json, false);
-    pretty(&json);
+    json_writer_open_stream(&out, stdout);
+    json_writer_set_indent(&out, 2);
+    pretty(&json, &out);
     if (json_get_error(&json)) {
         fprintf(stderr, "error: %zu: %s\n",
                 json_get_lineno(&json),
                 json_get_error(&json));
         exit(EXIT_FAILURE);
-    } else {
-        printf("\n");
     }
+    if (json_writer_close(&out) != 0) {
+        fprintf(stderr, "error: cannot write output\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("\n");
     json_close(&json);
-    free(jstr);
     return 0;
 }
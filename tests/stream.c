@@ -16,6 +16,8 @@ const char json_typename[][16] = {
     [JSON_TRUE]       = "TRUE",
     [JSON_FALSE]      = "FALSE",
     [JSON_NULL]       = "NULL",
+    [JSON_INCOMPLETE] = "INCOMPLETE",
+    [JSON_STRING_PART] = "STRING_PART",
 };
 
 int
@@ -51,6 +53,8 @@ main(void)
             case JSON_ARRAY_END:
             case JSON_ERROR:
             case JSON_DONE:
+            case JSON_INCOMPLETE:
+            case JSON_STRING_PART:
                 break;
         }
         if (value)
@@ -1,6 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#  include <signal.h>
+#  include <unistd.h>
+#  include <sys/select.h>
+#  include <sys/wait.h>
+#endif
 #include "../pdjson.h"
 
 #if _WIN32
@@ -56,6 +63,8 @@ const char json_typename[][16] = {
     [JSON_TRUE]       = "TRUE",
     [JSON_FALSE]      = "FALSE",
     [JSON_NULL]       = "NULL",
+    [JSON_INCOMPLETE] = "INCOMPLETE",
+    [JSON_STRING_PART] = "STRING_PART",
 };
 
 /* An allocator that fails once it has handed out budget allocations. */
@@ -90,6 +99,328 @@ dirty_malloc(size_t size)
     return ptr;
 }
 
+/* A context allocator keeping count of the bytes it has out, by the
+   sizes the library reports, which should come back to zero. */
+static void *
+ledger_malloc(void *ctx, size_t size)
+{
+    *(size_t *)ctx += size;
+    return malloc(size);
+}
+
+static void *
+ledger_realloc(void *ctx, void *ptr, size_t old_size, size_t size)
+{
+    *(size_t *)ctx += size - old_size;
+    return realloc(ptr, size);
+}
+
+static void
+ledger_free(void *ctx, void *ptr, size_t size)
+{
+    *(size_t *)ctx -= size;
+    free(ptr);
+}
+
+/* One step, feeding three more bytes whenever it comes up short. */
+static enum json_type
+fed_step(json_stream *json, enum json_type (*step)(json_stream *),
+         const char *str, size_t size, size_t *fed)
+{
+    enum json_type type;
+    while ((type = step(json)) == JSON_INCOMPLETE && *fed < size) {
+        size_t n = size - *fed < 3 ? size - *fed : 3;
+        json_feed(json, str + *fed, n);
+        *fed += n;
+    }
+    return type;
+}
+
+/* A transcript of every event in a stream, values included, reset after
+   each top-level value. Pushed data is fed chunk bytes at a time as it
+   is needed, or all of it at once for a chunk of zero. */
+static void
+transcript(json_stream *json, const char *str, size_t size, size_t chunk, char *out)
+{
+    size_t fed = 0, n = 0;
+    enum json_type type;
+    do {
+        type = json_next(json);
+        if (type == JSON_INCOMPLETE) {
+            size_t step = chunk == 0 || chunk > size - fed ? size - fed : chunk;
+            json_feed(json, str + fed, step);
+            fed += step;
+            continue;
+        }
+        out[n++] = '@' + type;
+        if (type == JSON_STRING || type == JSON_NUMBER) {
+            size_t length;
+            const char *s = json_get_string(json, &length);
+            memcpy(out + n, s, length);
+            n += length;
+        }
+        if (type == JSON_DONE && json_peek(json) != JSON_DONE) {
+            json_reset(json);
+            type = (enum json_type)0;
+        }
+    } while (type != JSON_DONE && type != JSON_ERROR);
+    out[n] = '\0';
+    if (type == JSON_ERROR)
+        strcpy(out + n, json_get_error(json));
+}
+
+/* A json_writer sink collecting everything it is given. */
+struct collect {
+    char data[1024];
+    size_t fill;
+    size_t calls;
+};
+
+static int
+collect_sink(const char *data, size_t size, void *user)
+{
+    struct collect *c = (struct collect *)user;
+    if (size > sizeof(c->data) - c->fill)
+        return -1;
+    memcpy(c->data + c->fill, data, size);
+    c->fill += size;
+    c->calls++;
+    return 0;
+}
+
+/* The same document, whichever way it is written. */
+static int
+write_document(json_writer *w)
+{
+    static const char name[] = "q\"b\\s\x01\n\x7f\xc3\xa9 long enough to scan in blocks";
+    json_write_begin_object(w);
+    json_write_key(w, "name", 4);
+    json_write_string(w, name, sizeof(name) - 1);
+    json_write_key(w, "n", 1);
+    json_write_begin_array(w);
+    json_write_int(w, INT64_MIN);
+    json_write_number(w, 0.1);
+    json_write_number(w, -0.0);
+    json_write_number(w, 1e21);
+    json_write_number(w, 5e-324);
+    json_write_number(w, 1.7976931348623157e308);
+    json_write_number(w, 2.0 / 3);
+    json_write_number(w, 42);
+    json_write_end_array(w);
+    json_write_key(w, "e", 1);
+    json_write_begin_object(w);
+    json_write_end_object(w);
+    json_write_key(w, "x", 1);
+    json_write_begin_array(w);
+    json_write_bool(w, true);
+    json_write_null(w);
+    json_write_raw(w, "[1]", 3);
+    json_write_end_array(w);
+    return json_write_end_object(w);
+}
+
+/* A json_open_user() source reading from a NUL-terminated string. */
+struct cursor {
+    const char *str;
+    size_t pos;
+};
+
+static int
+cursor_peek(void *user)
+{
+    struct cursor *cur = (struct cursor *)user;
+    return cur->str[cur->pos] ? (unsigned char)cur->str[cur->pos] : EOF;
+}
+
+static int
+cursor_get(void *user)
+{
+    struct cursor *cur = (struct cursor *)user;
+    int c = cursor_peek(user);
+    if (c != EOF)
+        cur->pos++;
+    return c;
+}
+
+/* A json_open_reader() source giving at most step bytes a read, and
+   failing once it gets to fail, if set. */
+struct reader {
+    const char *str;
+    size_t pos;
+    size_t step;
+    size_t fail;
+};
+
+static long
+reader_read(void *user, void *buffer, size_t size)
+{
+    struct reader *r = (struct reader *)user;
+    size_t n = strlen(r->str + r->pos);
+    if (r->fail && r->pos >= r->fail)
+        return -1;
+    if (n > size)
+        n = size;
+    if (n > r->step)
+        n = r->step;
+    memcpy(buffer, r->str + r->pos, n);
+    r->pos += n;
+    return n;
+}
+
+/* Parse all of a stream as events(), but with strings in parts of about
+   size bytes, which are checked and put back together into text. Slices
+   of a buffer come whole. */
+static int
+parts(json_stream *json, size_t size, char *out, size_t len, char *text)
+{
+    enum json_type type;
+    size_t i = 0, fill = 0;
+    int ok = 1;
+    json_set_string_parts(json, size);
+    do {
+        type = json_next(json);
+        if (type == JSON_STRING_PART || type == JSON_STRING) {
+            const char *s;
+            size_t n;
+            bool slice = json_get_slice(json, &s, &n);
+            ok &= slice || (n <= size + 3 && s[n] == '\0');
+            ok &= type == JSON_STRING || (n >= size && n > 0);
+            memcpy(text + fill, s, n);
+            fill += n;
+            if (type == JSON_STRING)
+                text[fill++] = '|';
+        }
+        if (type != JSON_STRING_PART && i + 1 < len)
+            out[i++] = '@' + type;
+    } while (type != JSON_DONE && type != JSON_ERROR);
+    out[i] = '\0';
+    text[fill] = '\0';
+    return ok;
+}
+
+/* Parse all of a stream, checking at each event that the line number is
+   one more than the newlines before the position. Returns the event the
+   stream ended with, or 0 if the lines were off. */
+static enum json_type
+lines(json_stream *json, const char *str)
+{
+    enum json_type type;
+    do {
+        size_t at, n = 1;
+        type = json_next(json);
+        at = json_get_position(json);
+        for (size_t i = 0; i < at; i++)
+            n += str[i] == '\n';
+        if (json_get_lineno(json) != n)
+            return (enum json_type)0;
+    } while (type != JSON_DONE && type != JSON_ERROR && type != JSON_INCOMPLETE);
+    return type;
+}
+
+/* Parse all of a stream, returning the events as a string of letters so
+   that different sources can be compared against each other. */
+static void
+events(json_stream *json, char *out, size_t len)
+{
+    enum json_type type;
+    size_t i = 0;
+    do {
+        type = json_next(json);
+        if (i + 1 < len)
+            out[i++] = '@' + type;
+    } while (type != JSON_DONE && type != JSON_ERROR);
+    out[i] = '\0';
+}
+
+/* NDJSON records of the form {"n": N}, each giving back N, or zero for a
+   record that fails to parse. */
+struct ndjson_check {
+    size_t count;
+    size_t last;
+    int ok;
+    unsigned char *seen;
+};
+
+static void *
+ndjson_record(json_stream *json, size_t offset, void *user)
+{
+    struct ndjson_check *check = (struct ndjson_check *)user;
+    size_t n = 0;
+    (void)offset;
+    if (json_next(json) == JSON_OBJECT && json_next(json) == JSON_STRING &&
+        json_next(json) == JSON_NUMBER) {
+        n = (size_t)json_get_number(json);
+        if (json_next(json) != JSON_OBJECT_END || json_next(json) != JSON_DONE)
+            n = 0;
+    }
+    if (check->seen != NULL)
+        check->seen[n] = 1;
+    return (void *)n;
+}
+
+/* As above, but each record first builds an index and keeps counts,
+   both of which must be let go before the next. */
+static void *
+ndjson_indexed(json_stream *json, size_t offset, void *user)
+{
+    json_build_index(json);
+    json_set_counts(json, true);
+    return ndjson_record(json, offset, user);
+}
+
+/* Records taking turns with the default allocator, a context one and an
+   arena, each of which must get back only what it handed out. */
+static size_t mixed_ledger, mixed_errors;
+static json_arena mixed_arena;
+
+static void *
+ndjson_mixed(json_stream *json, size_t offset, void *user)
+{
+    static const json_context_allocator ledger = {
+        ledger_malloc, ledger_realloc, ledger_free, &mixed_ledger
+    };
+    enum json_type type;
+    (void)user;
+    switch ((offset + 2) % 3) {
+    case 1:
+        json_set_context_allocator(json, &ledger);
+        break;
+    case 2:
+        json_set_arena(json, &mixed_arena);
+        break;
+    }
+    while ((type = json_next(json)) != JSON_DONE && type != JSON_ERROR)
+        ;
+    mixed_errors += type != JSON_DONE;
+    return NULL;
+}
+
+static void
+ndjson_result(void *result, size_t offset, void *user)
+{
+    struct ndjson_check *check = (struct ndjson_check *)user;
+    size_t n = (size_t)result;
+    check->ok &= n == check->count + 1 && (check->count == 0 || offset > check->last);
+    check->count++;
+    check->last = offset;
+}
+
+/* Extractor matches appended as "path=value;", the value being a
+   scalar's text or the letter of a container's type. Paths 0 to 2 read
+   their containers through, with "!" should that fail. */
+static void
+extract_match(json_stream *json, size_t path, enum json_type type, void *user)
+{
+    char *out = (char *)user + strlen((char *)user);
+    if (type == JSON_OBJECT || type == JSON_ARRAY) {
+        sprintf(out, "%zu=%c;", path, '@' + type);
+        if (path < 3 && json_skip_until(json, type + 1) != type + 1)
+            strcat(out, "!");
+    } else {
+        sprintf(out, "%zu=%s;", path, json_get_string(json, NULL));
+    }
+}
+
 static int
 has_value(enum json_type type)
 {
@@ -368,6 +699,825 @@ main(void)
         json_close(json);
     }
 
+    {
+        /* Long plain runs are copied in blocks; put the byte that ends
+           each run at every offset across several block boundaries */
+        char str[128], expect[128];
+        int ok = 1;
+        for (int i = 0; ok && i < 80; i++) {
+            static const char *const tails[][2] = {
+                {"\"", ""}, {"\\n\"", "\n"}, {"\xc3\xa9\"", "\xc3\xa9"},
+            };
+            for (int t = 0; ok && t < 3; t++) {
+                json_stream json[1];
+                size_t len;
+                memset(expect, 'x', i);
+                strcpy(expect + i, tails[t][1]);
+                str[0] = '"';
+                memset(str + 1, 'x', i);
+                strcpy(str + 1 + i, tails[t][0]);
+                json_open_string(json, str);
+                ok = json_next(json) == JSON_STRING &&
+                     !strcmp(json_get_string(json, &len), expect) &&
+                     len == strlen(expect) + 1;
+                json_close(json);
+            }
+        }
+        CHECK("long string runs", ok);
+    }
+
+    {
+        const char str[] = "\"0123456789abcdef0123456789abcdef\x01\"";
+        struct expect seq[] = {
+            {JSON_ERROR},
+        };
+        TEST("control byte after long run");
+    }
+
+    {
+        /* Runs of multi-byte text are validated in blocks; put valid and
+           broken sequences at every offset, from a buffer and byte by
+           byte */
+        static const struct {
+            const char *tail;
+            enum json_type type;
+        } tails[] = {
+            {"\xf0\x9f\x98\x80\"", JSON_STRING},
+            {"\xff\"", JSON_ERROR},
+            {"\xe4\xb8\"", JSON_ERROR},
+            {"\xed\xa0\x80\"", JSON_ERROR},
+            {"\xc0\xaf\"", JSON_ERROR},
+            {"\xf4\x90\x80\x80\"", JSON_ERROR},
+        };
+        char str[256];
+        int ok = 1;
+        for (int i = 0; ok && i < 40; i++) {
+            for (size_t t = 0; ok && t < countof(tails); t++) {
+                json_stream json[1];
+                struct cursor cur = {str, 0};
+                str[0] = '"';
+                for (int j = 0; j < i; j++)
+                    memcpy(str + 1 + 3 * j, "\xe4\xb8\xad", 3);
+                strcpy(str + 1 + 3 * i, tails[t].tail);
+                json_open_string(json, str);
+                ok = json_next(json) == tails[t].type;
+                json_close(json);
+                json_open_user(json, cursor_get, cursor_peek, &cur);
+                ok &= json_next(json) == tails[t].type;
+                json_close(json);
+            }
+        }
+        CHECK("utf-8 runs", ok);
+    }
+
+    {
+        /* A buffer validated up front still parses the same */
+        const char good[] = "[\"\xe4\xb8\xad\xe6\x96\x87\", \"\xf0\x9f\x98\x80\"]";
+        const char bad[] = "[\"ok\", \"\xe4\xb8\"]";
+        json_stream json[1];
+        const char *ptr;
+        char out[8];
+        size_t len;
+        json_open_buffer(json, good, sizeof(good) - 1);
+        CHECK("validate utf-8", json_validate_utf8(json));
+        json_next(json);
+        json_next(json);
+        CHECK("validated slice", json_get_slice(json, &ptr, &len) &&
+                                 ptr == good + 2 && len == 6);
+        json_close(json);
+        json_open_buffer(json, bad, sizeof(bad) - 1);
+        CHECK("validate bad utf-8", !json_validate_utf8(json));
+        events(json, out, sizeof(out));
+        CHECK("validate bad utf-8, error",
+              !strcmp(out, "EGA") &&
+              !strcmp(json_get_error(json), "invalid UTF-8 text"));
+        json_close(json);
+    }
+
+    {
+        /* A raw skip by the index lands where one without does, with
+           escaped quotes and backslashes on either side of each 64-byte
+           block boundary */
+        char str[256], a[64], b[64];
+        int ok = 1;
+        for (int i = 50; ok && i < 80; i++) {
+            static const char *const escapes[] = {
+                "\\\"", "\\\\", "\\\\\\\"", "\\\\\"x",
+            };
+            for (size_t e = 0; ok && e < countof(escapes); e++) {
+                json_stream json[1];
+                size_t lineno;
+                int n = snprintf(str, sizeof(str), "{\n  \"k\" :  [%*s\"%s]\" ,\n\t[1] ]\n}",
+                                 i - 12, "", escapes[e]);
+                size_t position;
+                json_open_buffer(json, str, n);
+                json_set_raw_skip(json, true);
+                json_next(json);
+                json_next(json);
+                ok = json_skip(json) == JSON_ARRAY;
+                position = json_get_position(json);
+                events(json, a, sizeof(a));
+                lineno = json_get_lineno(json);
+                json_close(json);
+                json_open_buffer(json, str, n);
+                json_set_raw_skip(json, true);
+                ok &= json_build_index(json);
+                json_next(json);
+                json_next(json);
+                ok &= json_skip(json) == JSON_ARRAY;
+                ok &= json_get_position(json) == position;
+                events(json, b, sizeof(b));
+                ok &= !strcmp(a, b) && lineno == json_get_lineno(json);
+                json_close(json);
+            }
+        }
+        CHECK("structural index", ok);
+    }
+
+    {
+        /* NDJSON spanning several chunks, with blank lines and CRLF */
+        size_t records = 300000, size = 0;
+        char *buf = malloc(records * 32);
+        struct ndjson_check check = {0, 0, 1, NULL};
+        int ok = 1;
+        for (size_t i = 1; i <= records; i++)
+            size += sprintf(buf + size, "{\"n\": %zu}%s", i,
+                            i % 7 == 0 ? "\r\n\n  \n" : "\n");
+        ok &= json_parallel_ndjson(buf, size, 4, ndjson_record,
+                                   ndjson_result, &check) == 0;
+        CHECK("ndjson ordered", ok && check.ok && check.count == records);
+
+        check.seen = calloc(records + 1, 1);
+        ok = json_parallel_ndjson(buf, size, 4, ndjson_record, NULL, &check) == 0;
+        for (size_t i = 0; i <= records; i++)
+            ok &= check.seen[i] == (i != 0);
+        CHECK("ndjson unordered", ok);
+
+        check.count = 0;
+        ok = json_parallel_ndjson(buf, size, 4, ndjson_indexed,
+                                  ndjson_result, &check) == 0;
+        CHECK("ndjson indexed", ok && check.ok && check.count == records);
+
+        json_arena_init(&mixed_arena, NULL, 0);
+        size = 0;
+        for (size_t i = 0; i < 1000; i++)
+            size += sprintf(buf + size, "{\"k\\u00e9%*s\": [[%zu]]}\n",
+                            (int)(i % 7), "", i);
+        ok = json_parallel_ndjson(buf, size, 1, ndjson_mixed, NULL, NULL) == 0;
+        CHECK("ndjson mixed allocators", ok && mixed_ledger == 0 && mixed_errors == 0);
+        json_arena_release(&mixed_arena);
+
+        memset(check.seen, 0, records + 1);
+        strcpy(buf, "{\"n\": 1}\n{\"n\": 2} x\n{\"n\": 3}");
+        ok = json_parallel_ndjson(buf, strlen(buf), 0, ndjson_record, NULL, &check) == 0;
+        CHECK("ndjson bad record", ok && check.seen[0] && check.seen[1] &&
+                                   !check.seen[2] && check.seen[3]);
+        free(check.seen);
+        free(buf);
+    }
+
+    {
+        /* JSON pointers, escapes and all, skipping what they pass */
+        const char str[] = "{\"payload\": {\"skip\": [1, {\"id\": 0}], "
+                           "\"items\": [0, 1, [2], {\"id\": 42, \"z\": true}], "
+                           "\"a/b\": 1, \"m~n\": 2}} [\"next\"]";
+        static const struct {
+            const char *pointer;
+            enum json_type type;
+            const char *value;
+        } finds[] = {
+            {"/payload/items/3/id", JSON_NUMBER, "42"},
+            {"/payload/a~1b", JSON_NUMBER, "1"},
+            {"/payload/m~0n", JSON_NUMBER, "2"},
+            {"/payload/items/2/0", JSON_NUMBER, "2"},
+            {"", JSON_OBJECT, NULL},
+            {"/payload/items/4", JSON_DONE, NULL},
+            {"/payload/items/-", JSON_DONE, NULL},
+            {"/payload/items/01", JSON_DONE, NULL},
+            {"/payload/missing/id", JSON_DONE, NULL},
+            {"/payload/skip/0/id", JSON_DONE, NULL},
+            {"payload", JSON_ERROR, NULL},
+            {"/payload/~2", JSON_ERROR, NULL},
+        };
+        int ok = 1;
+        for (size_t i = 0; i < countof(finds); i++) {
+            json_stream json[1];
+            enum json_type type;
+            json_open_buffer(json, str, sizeof(str) - 1);
+            type = json_find(json, finds[i].pointer);
+            ok &= type == finds[i].type;
+            if (finds[i].value)
+                ok &= !strcmp(json_get_string(json, NULL), finds[i].value);
+            if (type == JSON_DONE) {
+                /* the whole of the first value is behind us */
+                json_reset(json);
+                ok &= json_next(json) == JSON_ARRAY;
+            }
+            json_close(json);
+        }
+        CHECK("json pointer", ok);
+    }
+
+    {
+        /* Many paths in one pass, over record after record */
+        static const char *const paths[] = {
+            "/tags",         /* 0-2: read by the callback */
+            "/user",
+            "/geo",
+            "/id",
+            "/user/name",    /* not reached, /user having been read */
+            "/a~1b/1",
+            "/geo/lat",
+            "/list",         /* left alone, so /list/0 is reached */
+            "/list/0",
+            "/id",           /* a duplicate, never reported */
+        };
+        const char str[] =
+            "{\"id\": 1, \"skip\": {\"id\": 9}, \"user\": {\"name\": \"a\"}, "
+            "\"a/b\": [0, \"x\", 2], \"list\": [{\"q\": 1}, 3]}\n"
+            "{\"tags\": [1, [2]], \"geo\": {\"lat\": 5}, \"id\": 2, \"list\": 7}\n"
+            "[{\"id\": 3}]\n"
+            "{\"user\": {\"name\": \"b\", \"x\": [}}\n";
+        const char *expect[] = {
+            "3=1;1=C;5=x;7=E;8=C;",
+            "0=E;2=C;3=2;7=7;",
+            "",
+            "1=C;!",
+        };
+        json_extractor *ex = json_extractor_compile(paths, countof(paths));
+        int ok = ex != NULL;
+        for (int raw = 0; ok && raw < 2; raw++) {
+            json_stream json[1];
+            json_open_buffer(json, str, sizeof(str) - 1);
+            json_set_raw_skip(json, raw);
+            for (size_t i = 0; i < countof(expect); i++) {
+                char out[256] = "";
+                enum json_type type = json_extract(json, ex, extract_match, out);
+                ok &= type == (i == 2 ? JSON_ARRAY : i == 3 ? JSON_ERROR : JSON_OBJECT);
+                ok &= !strcmp(out, expect[i]);
+                json_reset(json);
+            }
+            json_close(json);
+        }
+        json_extractor_free(ex);
+        CHECK("extract", ok);
+
+        static const char *const bad[] = {"/ok", "no/slash"};
+        CHECK("extract bad pointer", json_extractor_compile(bad, 2) == NULL);
+    }
+
+    {
+        /* Escaped or not, the same text hashes the same */
+        const char str[] = "[\"ab\", \"a\\u0062\", \"abc\"]";
+        json_stream json[1];
+        uint64_t hash[3];
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_next(json);
+        for (size_t i = 0; i < countof(hash); i++) {
+            json_next(json);
+            hash[i] = json_get_string_hash(json);
+        }
+        json_close(json);
+        CHECK("string hash", hash[0] == hash[1] && hash[0] != hash[2]);
+    }
+
+    {
+        /* Key sets of all sizes map every key to its index */
+        static const size_t sizes[] = {0, 1, 2, 3, 80, 1000};
+        char text[1000][8];
+        const char *keys[1000];
+        char str[16000];
+        int ok = 1;
+        for (size_t i = 0; i < countof(keys); i++) {
+            sprintf(text[i], "k%zu", i);
+            keys[i] = text[i];
+        }
+        for (size_t s = 0; s < countof(sizes); s++) {
+            size_t n = sizes[s], fill;
+            json_keyset *ks = json_keyset_compile(keys, n);
+            json_stream json[1];
+            if (ks == NULL) {
+                ok = 0;
+                continue;
+            }
+            fill = sprintf(str, "[\"\", \"k\", \"k%zu\"", n);
+            for (size_t i = 0; i < n; i++)
+                fill += sprintf(str + fill, ", \"%s\"", keys[i]);
+            strcpy(str + fill, "]");
+            json_open_string(json, str);
+            json_next(json);
+            for (size_t i = 0; i < 3; i++) {
+                json_next(json);
+                ok &= json_keyset_lookup(ks, json) == SIZE_MAX;
+            }
+            for (size_t i = 0; i < n; i++) {
+                json_next(json);
+                ok &= json_keyset_lookup(ks, json) == i;
+            }
+            json_close(json);
+            json_keyset_free(ks);
+        }
+        CHECK("keyset", ok);
+    }
+
+    {
+        /* A repeated key keeps its first index */
+        static const char *const keys[] = {"id", "name", "id", "a\"b"};
+        const char str[] = "{\"name\": 1, \"i\\u0064\": 2, \"a\\\"b\": 3, \"x\": 4}";
+        static const size_t expect[] = {1, 0, 3, SIZE_MAX};
+        json_keyset *ks = json_keyset_compile(keys, countof(keys));
+        json_stream json[1];
+        int ok = ks != NULL;
+        json_open_string(json, str);
+        json_next(json);
+        for (size_t i = 0; ok && i < countof(expect); i++) {
+            ok &= json_next(json) == JSON_STRING;
+            ok &= json_keyset_lookup(ks, json) == expect[i];
+            json_skip(json);
+        }
+        json_close(json);
+        json_keyset_free(ks);
+        CHECK("keyset repeats", ok);
+    }
+
+    {
+        /* Escape-free strings and numbers are sliced from the buffer */
+        const char str[] = "[\"plain\", \"caf\xc3\xa9\", \"a\\tb\", -1.5e3]";
+        json_stream json[1];
+        const char *ptr;
+        size_t len;
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_next(json);
+        json_next(json);
+        CHECK("slice plain", json_get_slice(json, &ptr, &len) &&
+                             ptr == str + 2 && len == 5);
+        CHECK("slice plain, string", !strcmp(json_get_string(json, &len), "plain") &&
+                                     len == 6);
+        json_next(json);
+        CHECK("slice utf-8", json_get_slice(json, &ptr, &len) &&
+                             !memcmp(ptr, "caf\xc3\xa9", 5) && len == 5);
+        json_next(json);
+        CHECK("slice escape", !json_get_slice(json, &ptr, &len) &&
+                              !strcmp(ptr, "a\tb") && len == 3);
+        json_next(json);
+        CHECK("slice number", json_get_slice(json, &ptr, &len) &&
+                              !memcmp(ptr, "-1.5e3", 6) && len == 6);
+        CHECK("slice number, value", json_get_number(json) == -1500);
+        json_close(json);
+    }
+
+    {
+        /* Numbers convert correctly rounded, including the hard cases
+           that the fast paths have to hand on */
+        static const struct {
+            const char *str;
+            double value;
+        } numbers[] = {
+            {"-65.613616999999977", -65.613616999999977},
+            {"9007199254740993", 9007199254740992.0},
+            {"2.2250738585072011e-308", 2.2250738585072011e-308},
+            {"4.9406564584124654e-324", 4.9406564584124654e-324},
+            {"1.7976931348623157e308", 1.7976931348623157e308},
+            {"123456789012345678901234567890", 123456789012345678901234567890.0},
+            {"1.00000000000000011102230246251565404236316680908203125", 1.0},
+            {"1.00000000000000011102230246251565404236316680908203126", 1.0000000000000002},
+            {"1e-400", 0.0},
+        };
+        int ok = 1;
+        for (size_t i = 0; i < countof(numbers); i++) {
+            json_stream json[1];
+            json_open_string(json, numbers[i].str);
+            ok &= json_next(json) == JSON_NUMBER &&
+                  json_get_number(json) == numbers[i].value;
+            json_close(json);
+        }
+        CHECK("number conversion", ok);
+    }
+
+    {
+        /* 64-bit integers are exact, and overflow is reported */
+        const char str[] = "[9007199254740993, -9223372036854775808, "
+                           "18446744073709551616, 1.5, 25e-1, 2.50e1]";
+        json_stream json[1];
+        int64_t i;
+        uint64_t u;
+        long e;
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_next(json);
+        json_next(json);
+        CHECK("int64 beyond double", json_get_int64(json, &i) &&
+                                     i == 9007199254740993);
+        json_next(json);
+        CHECK("int64 minimum", json_get_int64(json, &i) && i == INT64_MIN);
+        CHECK("uint64 negative", !json_get_uint64(json, &u) && u == 0);
+        json_next(json);
+        CHECK("uint64 overflow", !json_get_uint64(json, &u) && u == UINT64_MAX);
+        CHECK("int64 overflow", !json_get_int64(json, &i) && i == INT64_MAX);
+        json_next(json);
+        CHECK("int64 fraction", !json_get_int64(json, &i) && i == 1);
+        json_next(json);
+        CHECK("decimal", json_get_decimal(json, &i, &e) && i == 25 && e == -1);
+        json_next(json);
+        CHECK("int64 exponent", json_get_int64(json, &i) && i == 25);
+        json_close(json);
+    }
+
+    {
+        /* Buffer and user sources agree on the position and line */
+        const char str[] = "[1,\n\"two\"]";
+        json_stream json[1];
+        struct cursor cur = {str, 0};
+        enum json_type type;
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_set_streaming(json, 0);
+        while ((type = json_next(json)) != JSON_DONE && type != JSON_ERROR);
+        CHECK("buffer position", json_get_position(json) == sizeof(str) - 1);
+        CHECK("buffer lineno", json_get_lineno(json) == 2);
+        json_close(json);
+
+        json_open_user(json, cursor_get, cursor_peek, &cur);
+        json_set_streaming(json, 0);
+        while ((type = json_next(json)) != JSON_DONE && type != JSON_ERROR);
+        CHECK("user position", json_get_position(json) == sizeof(str) - 1);
+        CHECK("user lineno", json_get_lineno(json) == 2);
+        json_close(json);
+    }
+
+    {
+        /* Reader sources too, however short their reads */
+        const char str[] = "{\"key\": [true, 12345, \"long\\nstring\"]}\n[]";
+        const size_t sizes[] = {1, 3, 4096};
+        char expect[32], out[32];
+        int ok = 1;
+        json_stream json[1];
+        json_open_string(json, str);
+        events(json, expect, sizeof(expect));
+        json_close(json);
+        for (size_t step = 1; step < 8; step++) {
+            for (size_t s = 0; s < countof(sizes); s++) {
+                struct reader r = {str, 0, step, 0};
+                json_open_reader(json, reader_read, &r);
+                json_set_buffer_size(json, sizes[s]);
+                events(json, out, sizeof(out));
+                ok &= !strcmp(out, expect) && json_get_position(json) == 38;
+                json_reset(json);
+                ok &= json_next(json) == JSON_ARRAY && json_get_lineno(json) == 2;
+                json_close(json);
+            }
+        }
+        CHECK("reader", ok);
+    }
+
+    {
+        struct reader r = {"[1, 2, 3]", 0, 4, 4};
+        json_stream json[1];
+        char out[32];
+        json_open_reader(json, reader_read, &r);
+        events(json, out, sizeof(out));
+        CHECK("reader, error", !strcmp(out, "EHA") &&
+              !strcmp(json_get_error(json), "read error"));
+        json_close(json);
+    }
+
+    {
+        /* FILE and descriptor sources see the same events whatever size
+           their blocks are, including blocks smaller than a token */
+        const char str[] = "{\"key\": [true, 12345, \"long string\"]}";
+        const size_t sizes[] = {0, 1, 3, 4096};
+        char expect[32], actual[32];
+        json_stream json[1];
+        FILE *f = tmpfile();
+        fwrite(str, 1, sizeof(str) - 1, f);
+        fflush(f);
+
+        json_open_buffer(json, str, sizeof(str) - 1);
+        events(json, expect, sizeof(expect));
+        json_close(json);
+
+        for (size_t i = 0; i < countof(sizes); i++) {
+            int ok;
+            rewind(f);
+            json_open_stream(json, f);
+            json_set_buffer_size(json, sizes[i]);
+            events(json, actual, sizeof(actual));
+            ok = !strcmp(expect, actual) &&
+                 json_get_position(json) == sizeof(str) - 1;
+            json_close(json);
+            CHECK("FILE source", ok);
+        }
+
+#ifndef _WIN32
+        for (size_t i = 0; i < countof(sizes); i++) {
+            int ok;
+            lseek(fileno(f), 0, SEEK_SET);
+            json_open_fd(json, fileno(f));
+            json_set_buffer_size(json, sizes[i]);
+            events(json, actual, sizeof(actual));
+            ok = !strcmp(expect, actual) &&
+                 json_get_position(json) == sizeof(str) - 1;
+            json_close(json);
+            CHECK("fd source", ok);
+        }
+#endif
+        fclose(f);
+    }
+
+#ifndef _WIN32
+    {
+        /* Values from a pipe arrive as soon as their bytes do. The writer
+           holds back the rest of the input until the reader acknowledges
+           the first number, or gives up after two seconds. */
+        int data[2], ack[2], status = 1, ok = 1;
+        pid_t pid;
+        signal(SIGPIPE, SIG_IGN);
+        pipe(data);
+        pipe(ack);
+        pid = fork();
+        if (pid == 0) {
+            struct timeval timeout = {2, 0};
+            fd_set set;
+            close(data[0]);
+            close(ack[1]);
+            write(data[1], "[1,", 3);
+            FD_ZERO(&set);
+            FD_SET(ack[0], &set);
+            status = select(ack[0] + 1, &set, NULL, NULL, &timeout) == 1 ? 0 : 1;
+            write(data[1], "2]", 2);
+            _exit(status);
+        } else {
+            json_stream json[1];
+            FILE *f;
+            close(data[1]);
+            close(ack[0]);
+            f = fdopen(data[0], "r");
+            json_open_stream(json, f);
+            ok &= json_next(json) == JSON_ARRAY;
+            ok &= json_next(json) == JSON_NUMBER;
+            write(ack[1], "", 1);
+            ok &= json_next(json) == JSON_NUMBER;
+            ok &= json_next(json) == JSON_ARRAY_END;
+            ok &= json_next(json) == JSON_DONE;
+            json_close(json);
+            fclose(f);
+            close(ack[1]);
+            waitpid(pid, &status, 0);
+        }
+        CHECK("FILE source, pipe", ok && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+#endif
+
+    {
+        /* A raw skip ignores brackets in strings and lands where the
+           checked one does, from every kind of source */
+        const char str[] = "{\"skip\": {\"s\": \"]}\\\\\\\"[{\", \"a\": [1,\n"
+                           "  [2, {\"x\": null}]]},\n \"keep\": [true]}";
+        FILE *f = tmpfile();
+        int ok = 1;
+        fwrite(str, 1, sizeof(str) - 1, f);
+        fflush(f);
+        for (int source = 0; source < 5; source++) {
+            for (int raw = 0; raw < 2; raw++) {
+                json_stream json[1];
+                struct cursor cur = {str, 0};
+                char out[16];
+                switch (source) {
+                case 0:
+                case 1:
+                    json_open_buffer(json, str, sizeof(str) - 1);
+                    if (source == 1)
+                        ok &= json_build_index(json);
+                    break;
+                case 2:
+                case 3:
+                    rewind(f);
+                    json_open_stream(json, f);
+                    json_set_buffer_size(json, source == 2 ? 3 : 0);
+                    break;
+                default:
+                    json_open_user(json, cursor_get, cursor_peek, &cur);
+                }
+                json_set_raw_skip(json, raw);
+                ok &= json_next(json) == JSON_OBJECT;
+                ok &= json_next(json) == JSON_STRING;
+                ok &= json_skip(json) == JSON_OBJECT;
+                ok &= json_get_lineno(json) == 2;
+                events(json, out, sizeof(out));
+                ok &= !strcmp(out, "GEIFDB") && json_get_lineno(json) == 3;
+                json_close(json);
+            }
+        }
+        fclose(f);
+        CHECK("raw skip", ok);
+    }
+
+    {
+        /* Line numbers, counted lazily, agree with the position wherever
+           they are asked for, across runs of whitespace of any length */
+        static char str[8192];
+        size_t len = 0;
+        FILE *f = tmpfile();
+        int ok = 1;
+        len += sprintf(str + len, "{\n");
+        for (int i = 0; i < 40; i++)
+            len += sprintf(str + len, "%*s\"k%d\": [\n\t\t%d,\r\n%*s\"s\"\n ]%s\n",
+                           i * 3 % 70, "", i, i, i % 5, "", i < 39 ? "," : "");
+        len += sprintf(str + len, "\n\n  x\n}");
+        fwrite(str, 1, len, f);
+        fflush(f);
+        for (int source = 0; source < 7; source++) {
+            json_stream json[1];
+            struct cursor cur = {str, 0};
+            struct reader r = {str, 0, 5, 0};
+            enum json_type type;
+            switch (source) {
+            case 0:
+            case 1:
+                json_open_buffer(json, str, len);
+                if (source == 1)
+                    ok &= json_build_index(json);
+                break;
+            case 2:
+            case 3:
+                rewind(f);
+                json_open_stream(json, f);
+                json_set_buffer_size(json, source == 2 ? 7 : 0);
+                break;
+            case 4:
+                json_open_user(json, cursor_get, cursor_peek, &cur);
+                break;
+            case 5:
+                json_open_reader(json, reader_read, &r);
+                json_set_buffer_size(json, 16);
+                break;
+            default:
+                json_open_feed(json);
+                for (size_t at = 0; at < len; at += 9) {
+                    json_feed(json, str + at, len - at < 9 ? len - at : 9);
+                    if ((type = lines(json, str)) != JSON_INCOMPLETE)
+                        break;
+                }
+            }
+            type = lines(json, str);
+            ok &= type == JSON_ERROR && json_get_lineno(json) == 164;
+            json_close(json);
+        }
+        fclose(f);
+        CHECK("lazy lineno", ok);
+    }
+
+    {
+        /* An error in a string is reported on the line the string began,
+           whatever the source, and not after the raw newline in it */
+        const char str[] = "[\n \"a\nb\", 1]";
+        FILE *f = tmpfile();
+        int ok = 1;
+        fwrite(str, 1, sizeof(str) - 1, f);
+        fflush(f);
+        for (int source = 0; source < 6; source++) {
+            json_stream json[1];
+            struct cursor cur = {str, 0};
+            struct reader r = {str, 0, 3, 0};
+            enum json_type type;
+            switch (source) {
+            case 0:
+                json_open_buffer(json, str, sizeof(str) - 1);
+                break;
+            case 1:
+            case 2:
+                rewind(f);
+                json_open_stream(json, f);
+                json_set_buffer_size(json, source == 1 ? 4 : 0);
+                break;
+            case 3:
+                json_open_user(json, cursor_get, cursor_peek, &cur);
+                break;
+            case 4:
+                json_open_reader(json, reader_read, &r);
+                json_set_buffer_size(json, 4);
+                break;
+            default:
+                json_open_feed(json);
+                json_feed(json, str, sizeof(str) - 1);
+                json_feed(json, NULL, 0);
+            }
+            ok &= json_next(json) == JSON_ARRAY;
+            while ((type = json_next(json)) != JSON_ERROR && type != JSON_DONE)
+                ;
+            ok &= type == JSON_ERROR && json_get_lineno(json) == 2;
+            json_close(json);
+        }
+        fclose(f);
+        CHECK("lineno in string", ok);
+    }
+
+    {
+        /* Only the checked skip notices malformed values, but both
+           notice a container left open */
+        const char bad[] = "[{\"a\" 1}, 2]";
+        const char open[] = "[[\"]\"";
+        json_stream json[1];
+        json_open_buffer(json, bad, sizeof(bad) - 1);
+        json_next(json);
+        CHECK("skip malformed", json_skip(json) == JSON_ERROR);
+        json_close(json);
+        json_open_buffer(json, bad, sizeof(bad) - 1);
+        json_set_raw_skip(json, true);
+        json_next(json);
+        CHECK("raw skip malformed", json_skip(json) == JSON_OBJECT &&
+                                    json_next(json) == JSON_NUMBER);
+        json_close(json);
+        json_open_buffer(json, open, sizeof(open) - 1);
+        json_set_raw_skip(json, true);
+        json_next(json);
+        CHECK("raw skip unterminated", json_skip(json) == JSON_ERROR);
+        json_close(json);
+    }
+
+#ifndef _WIN32
+    {
+        /* A mapped file parses as a buffer, so strings can be sliced */
+        const char str[] = "{\"key\": [true, 12345, \"long string\"]}";
+        char path[] = "/tmp/pdjson-XXXXXX";
+        char expect[32], actual[32];
+        const char *ptr;
+        size_t len;
+        json_stream json[1];
+        int fd = mkstemp(path);
+        write(fd, str, sizeof(str) - 1);
+        close(fd);
+
+        json_open_buffer(json, str, sizeof(str) - 1);
+        events(json, expect, sizeof(expect));
+        json_close(json);
+
+        CHECK("file open", json_open_file(json, path) == 0);
+        json_next(json);
+        json_next(json);
+        CHECK("file slice", json_get_slice(json, &ptr, &len) && len == 3);
+        json_close(json);
+
+        json_open_file(json, path);
+        events(json, actual, sizeof(actual));
+        CHECK("file events", !strcmp(expect, actual));
+        json_close(json);
+
+        remove(path);
+        CHECK("file missing", json_open_file(json, path) != 0 &&
+                              json_next(json) == JSON_ERROR);
+        json_close(json);
+    }
+#endif
+
+    {
+        /* Caller storage, with every allocation failing */
+        const char str[] = "[[\"abc\\u00e9\"], {\"k\": 1.5}] [[[1]]] [\"abcdefg\\n\"]";
+        json_stream json[1];
+        json_allocator alloc = {budget_malloc, budget_realloc, free};
+        unsigned char stack[JSON_STACK_SIZE(2)];
+        char string[8];
+        enum json_type type;
+        const char *ptr;
+        size_t len;
+        int ok;
+        budget = 0;
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_set_allocator(json, &alloc);
+        json_set_storage(json, stack, sizeof(stack), string, sizeof(string));
+        ok = json_next(json) == JSON_ARRAY && json_next(json) == JSON_ARRAY;
+        ok &= json_next(json) == JSON_STRING;
+        ok &= !json_get_slice(json, &ptr, &len) && len == 5 && !memcmp(ptr, "abc\xc3\xa9", 5);
+        ok &= ptr == string;
+        while ((type = json_next(json)) != JSON_DONE && type != JSON_ERROR);
+        ok &= type == JSON_DONE;
+        json_reset(json);
+        ok &= json_next(json) == JSON_ARRAY && json_next(json) == JSON_ARRAY;
+        ok &= json_next(json) == JSON_ERROR;
+        CHECK("storage, depth", ok && json_get_depth(json) == 2 &&
+              !strcmp(json_get_error(json), "maximum depth of nesting reached"));
+        json_close(json);
+
+        json_open_string(json, strstr(str, "[\"abcdefg"));
+        json_set_allocator(json, &alloc);
+        json_set_storage(json, stack, JSON_STACK_SIZE(2), string, sizeof(string));
+        ok = json_next(json) == JSON_ARRAY && json_next(json) == JSON_ERROR;
+        CHECK("storage, length", ok &&
+              !strcmp(json_get_error(json), "maximum length of token reached"));
+        json_close(json);
+
+        /* Storage arriving inside a value is turned away, and the stack
+           in use carries on */
+        json_open_string(json, "[[\"abc\"],[[1]]]");
+        ok = json_next(json) == JSON_ARRAY && json_next(json) == JSON_ARRAY;
+        json_set_storage(json, stack, sizeof(stack), string, sizeof(string));
+        ok &= json->stack != stack && json->data.string != string;
+        ok &= json_next(json) == JSON_STRING && json_next(json) == JSON_ARRAY_END;
+        ok &= json_next(json) == JSON_ARRAY && json_next(json) == JSON_ARRAY;
+        ok &= json_get_depth(json) == 3 && json_next(json) == JSON_NUMBER;
+        while ((type = json_next(json)) != JSON_DONE && type != JSON_ERROR);
+        CHECK("storage, inside a value", ok && type == JSON_DONE);
+        json_close(json);
+    }
+
     {
         /* A push that cannot allocate must not enter the container */
         const char str[] = "[1]";
@@ -383,24 +1533,570 @@ main(void)
     }
 
     {
-        /* Same, but with the first block of PDJSON_STACK_INC (4) in hand,
-           so that the failed push lands just past the allocation */
-        const char str[] = "[[[[[1]]]]]";
+        /* Same, but with the first block of PDJSON_STACK_INIT (32) in
+           hand, so that the failed push lands just past the allocation */
+        char str[80];
         json_stream json[1];
         json_allocator alloc = {budget_malloc, budget_realloc, free};
         size_t count = (size_t)-1;
+        memset(str, '[', 33);
+        strcpy(str + 33, "1");
         budget = 1;
-        json_open_buffer(json, str, sizeof(str) - 1);
+        json_open_string(json, str);
         json_set_allocator(json, &alloc);
-        for (int i = 0; i < 4; i++)
+        for (int i = 0; i < 32; i++)
             json_next(json);
         CHECK("full stack, error", json_next(json) == JSON_ERROR);
-        CHECK("full stack, depth", json_get_depth(json) == 4);
+        CHECK("full stack, depth", json_get_depth(json) == 32);
         CHECK("full stack, context", json_get_context(json, &count) == JSON_ARRAY);
         CHECK("full stack, count", count == 0);
         json_close(json);
     }
 
+    {
+        /* Sizes reported to a context allocator add up */
+        const char str[] = "[[[[[[\"a long enough string to be copied \\u0021\"]]]]]]";
+        size_t outstanding = 0;
+        json_context_allocator alloc = {ledger_malloc, ledger_realloc, ledger_free, NULL};
+        json_stream json[1];
+        alloc.ctx = &outstanding;
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_set_context_allocator(json, &alloc);
+        json_build_index(json);
+        while (json_next(json) != JSON_DONE)
+            ;
+        CHECK("context allocator", outstanding > 0);
+        json_close(json);
+        CHECK("context allocator, sizes", outstanding == 0);
+    }
+
+    {
+        /* Streams on an arena, some of it supplied and the rest from
+           chunks, all released at once */
+        static char buffer[2048];
+        json_arena arena[1];
+        char str[8192];
+        int ok = 1;
+        size_t fill = 0;
+        for (int i = 0; i < 100; i++)
+            fill += sprintf(str + fill, "[{\"key\": \"%0*d\\n\"}, ", 40, i);
+        fill += sprintf(str + fill, "0");
+        for (int i = 0; i < 100; i++)
+            fill += sprintf(str + fill, "]");
+        json_arena_init(arena, buffer, sizeof(buffer));
+        for (int round = 0; round < 3; round++) {
+            json_stream json[2];
+            for (int k = 0; k < 2; k++) {
+                json_open_string(&json[k], str);
+                json_set_arena(&json[k], arena);
+            }
+            for (int i = 0; i < 100; i++) {
+                for (int k = 0; k < 2; k++) {
+                    char expect[64];
+                    size_t length;
+                    sprintf(expect, "%0*d\n", 40, i);
+                    json_next(&json[k]);
+                    json_next(&json[k]);
+                    json_next(&json[k]);
+                    ok &= json_next(&json[k]) == JSON_STRING;
+                    ok &= !strcmp(json_get_string(&json[k], &length), expect);
+                    ok &= length == 42;
+                    ok &= json_next(&json[k]) == JSON_OBJECT_END;
+                }
+            }
+            for (int k = 0; k < 2; k++) {
+                ok &= json_get_depth(&json[k]) == 100;
+                json_close(&json[k]);
+            }
+            ok &= arena->chunks != NULL;
+            json_arena_release(arena);
+            ok &= arena->chunks == NULL;
+        }
+        CHECK("arena", ok);
+    }
+
+    {
+        /* A document on a tape, walked by index */
+        const char str[] = "{\"id\": 12345678901234567, \"name\": \"a\\u0000b\", "
+                           "\"list\": [[], {}, [1, [2]], true, null, 2.5], \"ok\": false} 7";
+        static const char events[] = "CGHGGGEEFCDEHEHFFIKHFGJD";
+        static char buffer[512];
+        json_arena arena[1];
+        json_stream json[1];
+        const json_tape *tape;
+        int ok = 1;
+        json_arena_init(arena, buffer, sizeof(buffer));
+        json_open_buffer(json, str, sizeof(str) - 1);
+        tape = json_parse_tape(json, arena);
+        if (tape != NULL) {
+            size_t i, list, length;
+            int64_t id;
+            ok &= tape->size == sizeof(events) - 1;
+            for (i = 0; i < tape->size; i++)
+                ok &= json_tape_type(tape, i) == (enum json_type)(events[i] - '@');
+            ok &= json_tape_next(tape, 0) == tape->size;
+            ok &= json_tape_int64(tape, json_tape_member(tape, 0, "id"), &id);
+            ok &= id == 12345678901234567;
+            ok &= !memcmp(json_tape_string(tape, json_tape_member(tape, 0, "name"), &length),
+                          "a\0b", 4) && length == 3;
+            ok &= json_tape_member(tape, 0, "nope") == SIZE_MAX;
+            ok &= json_tape_type(tape, json_tape_member(tape, 0, "ok")) == JSON_FALSE;
+
+            /* elements skip over nested containers in one step */
+            list = json_tape_member(tape, 0, "list");
+            for (length = 0, i = list + 1; json_tape_type(tape, i) != JSON_ARRAY_END;
+                 i = json_tape_next(tape, i))
+                length++;
+            ok &= length == 6 && json_tape_number(tape, i - 1) == 2.5;
+            ok &= (tape->words[i] & ((UINT64_C(1) << 56) - 1)) == list;
+        } else {
+            ok = 0;
+        }
+        json_reset(json);
+        tape = json_parse_tape(json, arena);
+        ok &= tape != NULL && tape->size == 1 && json_tape_number(tape, 0) == 7;
+        json_reset(json);
+        ok &= json_parse_tape(json, arena) == NULL && json_get_error(json) == NULL;
+        json_close(json);
+        json_arena_release(arena);
+        CHECK("tape", ok);
+    }
+
+    {
+        const char str[] = "[1, {\"a\": [}]";
+        json_arena arena[1];
+        json_stream json[1];
+        json_arena_init(arena, NULL, 0);
+        json_open_buffer(json, str, sizeof(str) - 1);
+        CHECK("tape, error", json_parse_tape(json, arena) == NULL && json_get_error(json));
+        json_close(json);
+        json_arena_release(arena);
+    }
+
+    {
+        /* The elements of an array taken a tape at a time, until the
+           array's end comes up in place of another */
+        const char str[] = "[1, {\"a\": 2}, []] 3";
+        json_arena arena[1];
+        json_stream json[1];
+        const json_tape *tape;
+        size_t count = 0;
+        int ok;
+        json_arena_init(arena, NULL, 0);
+        json_open_buffer(json, str, sizeof(str) - 1);
+        json_set_streaming(json, true);
+        ok = json_next(json) == JSON_ARRAY;
+        while ((tape = json_parse_tape(json, arena)) != NULL) {
+            static const size_t sizes[] = {1, 4, 2};
+            ok &= count < countof(sizes) && tape->size == sizes[count];
+            count++;
+        }
+        ok &= count == 3 && json_get_error(json) == NULL;
+        ok &= json_next(json) == JSON_DONE;
+        json_reset(json);
+        ok &= json_next(json) == JSON_NUMBER;
+        json_close(json);
+        json_arena_release(arena);
+        CHECK("tape, elements", ok);
+    }
+
+    {
+        static const char compact[] =
+            "{\"name\":\"q\\\"b\\\\s\\u0001\\n\x7f\xc3\xa9 long enough to scan in blocks\","
+            "\"n\":[-9223372036854775808,0.1,-0,1e+21,5e-324,"
+            "1.7976931348623157e+308,0.6666666666666666,42],\"e\":{},"
+            "\"x\":[true,null,[1]]}";
+        static const char indented[] =
+            "{\n"
+            "  \"e\": {},\n"
+            "  \"x\": [\n"
+            "    [],\n"
+            "    1\n"
+            "  ]\n"
+            "}\n"
+            "2";
+        json_writer w[1];
+        struct collect c = {{0}, 0, 0};
+        char small[16];
+        const char *out;
+        size_t length;
+        int ok;
+
+        json_writer_open_buffer(w);
+        ok = write_document(w) == 0;
+        out = json_writer_get_buffer(w, &length);
+        CHECK("writer", ok && length == sizeof(compact) - 1 && !strcmp(out, compact));
+        json_writer_close(w);
+
+        json_writer_open_user(w, small, sizeof(small), collect_sink, &c);
+        ok = write_document(w) == 0 && json_writer_close(w) == 0;
+        CHECK("writer, sink", ok && c.fill == sizeof(compact) - 1 &&
+                              !memcmp(c.data, compact, c.fill) && c.calls > 1);
+
+        json_writer_open_buffer(w);
+        json_writer_set_indent(w, 2);
+        json_write_begin_object(w);
+        json_write_key(w, "e", 1);
+        json_write_begin_object(w);
+        json_write_end_object(w);
+        json_write_key(w, "x", 1);
+        json_write_begin_array(w);
+        json_write_begin_array(w);
+        json_write_end_array(w);
+        json_write_int(w, 1);
+        json_write_end_array(w);
+        json_write_end_object(w);
+        json_write_int(w, 2);
+        CHECK("writer, indent", !strcmp(json_writer_get_buffer(w, NULL), indented));
+        json_writer_close(w);
+
+        json_writer_open_user(w, small, sizeof(small), NULL, NULL);
+        json_write_string(w, "short", 5);
+        ok = json_write_string(w, "too long by now", 15) == -1;
+        CHECK("writer, full", ok && json_writer_close(w) == -1);
+
+        json_writer_open_buffer(w);
+        ok = json_write_number(w, 1.0 / 0.0 - 1.0 / 0.0) == -1;
+        ok &= json_write_end_array(w) == -1;
+        ok &= json_writer_close(w) == -1;
+
+        /* a key outside an object */
+        json_writer_open_buffer(w);
+        ok &= json_write_key(w, "k", 1) == -1;
+        ok &= json_writer_close(w) == -1;
+        json_writer_open_buffer(w);
+        json_write_begin_array(w);
+        ok &= json_write_key(w, "k", 1) == -1;
+        ok &= json_write_int(w, 1) == -1;
+        ok &= json_writer_close(w) == -1;
+
+        /* a value in an object without a key, and a key after a key */
+        json_writer_open_buffer(w);
+        json_write_begin_object(w);
+        ok &= json_write_int(w, 5) == -1;
+        ok &= json_writer_close(w) == -1;
+        json_writer_open_buffer(w);
+        json_write_begin_object(w);
+        json_write_key(w, "a", 1);
+        ok &= json_write_key(w, "b", 1) == -1;
+        ok &= json_writer_close(w) == -1;
+
+        /* mismatched ends, at any depth */
+        json_writer_open_buffer(w);
+        json_write_begin_object(w);
+        ok &= json_write_end_array(w) == -1;
+        ok &= json_writer_close(w) == -1;
+        json_writer_open_buffer(w);
+        for (int i = 0; i < 40; i++) {
+            json_write_begin_object(w);
+            json_write_key(w, "k", 1);
+            json_write_begin_array(w);
+        }
+        ok &= json_write_end_array(w) == 0;
+        ok &= json_write_end_array(w) == -1;
+        ok &= json_writer_close(w) == -1;
+
+        /* a buffer of no size is as none */
+        memset(&c, 0, sizeof(c));
+        json_writer_open_user(w, small, 0, collect_sink, &c);
+        ok &= json_write_string(w, "fits", 4) == 0;
+        ok &= json_writer_close(w) == 0 && c.fill == 6 && !memcmp(c.data, "\"fits\"", 6);
+        CHECK("writer, errors", ok);
+    }
+
+    {
+        /* Written doubles read back the same */
+        json_writer w[1];
+        json_stream json[1];
+        uint64_t bits = 0x9E3779B97F4A7C15;
+        int ok = 1;
+        json_writer_open_buffer(w);
+        json_write_begin_array(w);
+        for (int i = 0; i < 10000; i++) {
+            double d;
+            bits = bits * 6364136223846793005 + 1442695040888963407;
+            memcpy(&d, &bits, sizeof(d));
+            if (d == d && d - d == 0)
+                json_write_number(w, d);
+        }
+        json_write_end_array(w);
+        json_open_buffer(json, json_writer_get_buffer(w, NULL), w->fill);
+        json_next(json);
+        bits = 0x9E3779B97F4A7C15;
+        for (int i = 0; i < 10000; i++) {
+            double d;
+            bits = bits * 6364136223846793005 + 1442695040888963407;
+            memcpy(&d, &bits, sizeof(d));
+            if (d == d && d - d == 0)
+                ok &= json_next(json) == JSON_NUMBER && json_get_number(json) == d;
+        }
+        ok &= json_next(json) == JSON_ARRAY_END;
+        json_close(json);
+        json_writer_close(w);
+        CHECK("writer, round trip", ok);
+    }
+
+    {
+        /* Doubles are laid out as JavaScript's Number.prototype.toString */
+        static const double values[] = {
+            1e-7, 1.5e-7, 0.000001, 0.000123, 123.456, 1e20, 1e21,
+            1.25e22, 9007199254740993.0, 2.2250738585072014e-308, -1.5e-300,
+        };
+        static const char expect[] =
+            "[1e-7,1.5e-7,0.000001,0.000123,123.456,100000000000000000000,"
+            "1e+21,1.25e+22,9007199254740992,2.2250738585072014e-308,"
+            "-1.5e-300]";
+        json_writer w[1];
+        json_writer_open_buffer(w);
+        json_write_begin_array(w);
+        for (size_t i = 0; i < countof(values); i++)
+            json_write_number(w, values[i]);
+        json_write_end_array(w);
+        CHECK("writer, number layout", !strcmp(json_writer_get_buffer(w, NULL), expect));
+        json_writer_close(w);
+    }
+
+    {
+        /* Pushed a byte at a time or in any other chunks, the events come
+           out as they would from a buffer, whichever tokens the chunks
+           split, be it within a string, an escape or a number */
+        static const char *const docs[] = {
+            "{\"k\\u00e9y\": [1.5e+3, -0, \"a\\\"\\ud83d\\ude00\\n\"], \"t\": true,"
+            " \"f\": false, \"n\": null}  \n\n[12345678901234567890] 7 \"x\"",
+            "[1, 2 3]",
+            "[\"\\ud800\"]",
+            "{\"a\": tru}",
+            "[1.",
+            "  ",
+        };
+        int ok = 1;
+        for (size_t d = 0; d < countof(docs); d++) {
+            size_t size = strlen(docs[d]);
+            char expect[512], got[512];
+            json_stream json[1];
+            json_open_buffer(json, docs[d], size);
+            transcript(json, docs[d], size, 0, expect);
+            json_close(json);
+            for (size_t chunk = 0; chunk <= size; chunk++) {
+                json_open_feed(json);
+                if (json_next(json) != JSON_INCOMPLETE)
+                    ok = 0;
+                transcript(json, docs[d], size, chunk, got);
+                ok &= !strcmp(got, expect);
+                json_close(json);
+            }
+        }
+        CHECK("feed", ok);
+    }
+
+    {
+        /* Batches give what single events do, from any source */
+        const char str[] = "{\"a\\nb\": [1, -2.5e3, {\"c\": null}], \"d\": true} ";
+        int ok = 1;
+        for (int source = 0; source < 2; source++) {
+            json_stream expect[1], json[1];
+            json_arena arena;
+            json_token tokens[4];
+            size_t n;
+            json_open_string(expect, str);
+            if (source == 0) {
+                json_open_string(json, str);
+            } else {
+                json_open_feed(json);
+                json_feed(json, str, sizeof(str) - 1);
+                json_feed(json, "", 0);
+            }
+            json_arena_init(&arena, NULL, 0);
+            do {
+                n = json_next_batch(json, tokens, 4, &arena);
+                for (size_t i = 0; i < n; i++) {
+                    enum json_type type = json_next(expect);
+                    ok &= tokens[i].type == type;
+                    ok &= tokens[i].depth == json_get_depth(expect);
+                    if (type == JSON_STRING || type == JSON_NUMBER) {
+                        size_t length;
+                        const char *text = json_get_string(expect, &length);
+                        ok &= tokens[i].length == length - 1;
+                        ok &= !memcmp(tokens[i].text, text, length - 1);
+                    }
+                }
+            } while (n == 4);
+            ok &= n > 0 && tokens[n - 1].type == JSON_DONE;
+            json_close(expect);
+            json_close(json);
+            json_arena_release(&arena);
+        }
+        CHECK("next batch", ok);
+    }
+
+    {
+        /* Strings in parts are the same strings, from any source */
+        static char str[8192], whole[8192], text[8192];
+        char expect[64], out[64];
+        const char *pieces[] = {"plain ", "\\n\\u00e9", "\xe4\xb8\xad", "\\ud83d\\ude00", "x"};
+        const size_t sizes[] = {1, 2, 5, 16, 1000};
+        size_t len = 0, fill = 0;
+        int ok = 1;
+        json_stream json[1];
+
+        len += sprintf(str + len, "{\"");
+        for (int i = 0; i < 40; i++)
+            len += sprintf(str + len, "%s", pieces[i % countof(pieces)]);
+        len += sprintf(str + len, "\": [\"abc\", \"");
+        for (int i = 0; i < 300; i++)
+            len += sprintf(str + len, "%s", pieces[(i * 7) % countof(pieces)]);
+        len += sprintf(str + len, "\", 1, \"\"], \"k\": \"");
+        for (int i = 0; i < 500; i++)
+            len += sprintf(str + len, "%s", pieces[0]);
+        len += sprintf(str + len, "\"}");
+
+        json_open_buffer(json, str, len);
+        events(json, expect, sizeof(expect));
+        json_close(json);
+        json_open_buffer(json, str, len);
+        for (enum json_type type; (type = json_next(json)) != JSON_DONE;) {
+            if (type == JSON_STRING) {
+                size_t n;
+                const char *s = json_get_string(json, &n);
+                memcpy(whole + fill, s, n - 1);
+                fill += n - 1;
+                whole[fill++] = '|';
+            }
+        }
+        whole[fill] = '\0';
+        json_close(json);
+
+        for (size_t s = 0; s < countof(sizes); s++) {
+            for (int source = 0; source < 3; source++) {
+                struct reader r = {str, 0, 7, 0};
+                switch (source) {
+                case 0:
+                    json_open_buffer(json, str, len);
+                    break;
+                case 1:
+                    json_open_reader(json, reader_read, &r);
+                    json_set_buffer_size(json, 64);
+                    break;
+                default:
+                    json_open_feed(json);
+                    json_feed(json, str, len);
+                    json_feed(json, "", 0);
+                }
+                ok &= parts(json, sizes[s], out, sizeof(out), text);
+                ok &= !strcmp(out, expect) && !strcmp(text, whole);
+                json_close(json);
+            }
+        }
+        CHECK("string parts", ok);
+
+        /* Fed a little at a time, parts come before the closing quote */
+        json_open_feed(json);
+        json_set_string_parts(json, 16);
+        fill = 0;
+        for (size_t at = 0, n; at <= len; at += n) {
+            enum json_type type;
+            n = len - at < 13 ? len - at : 13;
+            json_feed(json, str + at, n);
+            while ((type = json_next(json)) != JSON_INCOMPLETE && type != JSON_DONE) {
+                if (type == JSON_STRING_PART || type == JSON_STRING) {
+                    size_t length;
+                    const char *s = json_get_string(json, &length);
+                    ok &= length - 1 <= 16 + 3;
+                    memcpy(text + fill, s, length - 1);
+                    fill += length - 1;
+                    if (type == JSON_STRING)
+                        text[fill++] = '|';
+                }
+            }
+            if (n == 0)
+                break;
+        }
+        text[fill] = '\0';
+        CHECK("string parts, feed", ok && !strcmp(text, whole));
+        json_close(json);
+
+        json_open_buffer(json, str, len);
+        json_set_string_parts(json, 16);
+        ok = json_next(json) == JSON_OBJECT && json_next(json) == JSON_STRING_PART;
+        ok &= json_skip(json) == JSON_STRING && json_next(json) == JSON_ARRAY;
+        ok &= json_next(json) == JSON_STRING && json_skip(json) == JSON_STRING;
+        ok &= json_next(json) == JSON_NUMBER && json_get_context(json, 0) == JSON_ARRAY;
+        CHECK("string parts, skip", ok);
+        json_close(json);
+
+        json_arena arena;
+        const json_tape *tape;
+        json_arena_init(&arena, NULL, 0);
+        json_open_buffer(json, str, len);
+        json_set_string_parts(json, 16);
+        ok = (tape = json_parse_tape(json, &arena)) != NULL;
+        fill = 0;
+        for (size_t i = 0; ok && i < tape->size; i++) {
+            if (json_tape_type(tape, i) == JSON_STRING) {
+                size_t n;
+                const char *s = json_tape_string(tape, i, &n);
+                memcpy(text + fill, s, n);
+                fill += n;
+                text[fill++] = '|';
+            }
+        }
+        text[fill] = '\0';
+        CHECK("string parts, tape", ok && !strcmp(text, whole));
+        json_close(json);
+        json_arena_release(&arena);
+    }
+
+    {
+        /* Done with a value, and not streaming, the end is awaited */
+        json_stream json[1];
+        json_open_feed(json);
+        json_set_streaming(json, false);
+        json_feed(json, "[1]", 3);
+        int ok = json_next(json) == JSON_ARRAY;
+        ok &= json_peek(json) == JSON_NUMBER && json_next(json) == JSON_NUMBER;
+        ok &= json_next(json) == JSON_ARRAY_END;
+        ok &= json_next(json) == JSON_INCOMPLETE;
+        json_feed(json, " \n", 2);
+        ok &= json_next(json) == JSON_INCOMPLETE;
+        ok &= json_get_position(json) == 3 && json_get_lineno(json) == 1;
+        json_feed(json, "", 0);
+        ok &= json_next(json) == JSON_DONE;
+        json_close(json);
+        CHECK("feed, end", ok);
+    }
+
+    {
+        /* A skip that runs out of fed input carries on from there, even
+           within a string in parts; searches want the whole input */
+        static const char str[] =
+            "[[1,[2,{\"a\":[]}]],\"a string in parts\",{\"b\":[3]},4]";
+        json_stream json[1];
+        size_t fed = 0;
+        int ok;
+        json_open_feed(json);
+        json_set_string_parts(json, 4);
+        ok = fed_step(json, json_next, str, sizeof(str) - 1, &fed) == JSON_ARRAY;
+        ok &= fed_step(json, json_skip, str, sizeof(str) - 1, &fed) == JSON_ARRAY;
+        ok &= fed_step(json, json_next, str, sizeof(str) - 1, &fed) == JSON_STRING_PART;
+        ok &= fed_step(json, json_skip, str, sizeof(str) - 1, &fed) == JSON_STRING;
+        ok &= fed_step(json, json_skip, str, sizeof(str) - 1, &fed) == JSON_OBJECT;
+        ok &= fed_step(json, json_next, str, sizeof(str) - 1, &fed) == JSON_NUMBER;
+        ok &= json_get_number(json) == 4;
+        ok &= fed_step(json, json_next, str, sizeof(str) - 1, &fed) == JSON_ARRAY_END;
+        json_close(json);
+
+        json_open_feed(json);
+        json_feed(json, str, sizeof(str) - 1);
+        ok &= json_find(json, "/2/b/0") == JSON_ERROR && json_get_error(json) != NULL;
+        json_close(json);
+        json_open_feed(json);
+        json_feed(json, str, sizeof(str) - 1);
+        json_feed(json, "", 0);
+        ok &= json_find(json, "/2/b/0") == JSON_NUMBER && json_get_number(json) == 3;
+        json_close(json);
+        CHECK("feed, skip", ok);
+    }
+
     {
         /* A token that failed part way is still terminated, so that the
            accessors cannot run past the bytes the parser wrote */
@@ -427,6 +2123,42 @@ main(void)
         json_close(json);
     }
 
+    {
+        /* Counts are exact when asked for, and otherwise stand in for the
+           count as zero, odd (1) or even (2), whatever the depth */
+        static char str[16384];
+        size_t len = 0, count = 0;
+        json_stream json[1];
+        int ok = 1;
+        for (int i = 0; i < 500; i++)
+            len += sprintf(str + len, "[1, 2, {\"a\": 3, \"b\": ");
+        len += sprintf(str + len, "null");
+        for (int i = 0; i < 500; i++)
+            len += sprintf(str + len, "}, 4]");
+        for (int counts = 0; counts < 2; counts++) {
+            json_open_buffer(json, str, len);
+            json_set_counts(json, counts);
+            for (int i = 0; i < 500; i++) {
+                ok &= json_next(json) == JSON_ARRAY && json_next(json) == JSON_NUMBER;
+                ok &= json_next(json) == JSON_NUMBER && json_get_context(json, &count) == JSON_ARRAY;
+                ok &= count == 2;
+                ok &= json_next(json) == JSON_OBJECT && json_next(json) == JSON_STRING;
+                ok &= json_get_context(json, &count) == JSON_OBJECT && count == 1;
+                ok &= json_next(json) == JSON_NUMBER && json_next(json) == JSON_STRING;
+                ok &= json_get_context(json, &count) == JSON_OBJECT && count == (counts ? 3 : 1);
+            }
+            ok &= json_next(json) == JSON_NULL && json_get_depth(json) == 1000;
+            for (int i = 0; i < 500; i++) {
+                ok &= json_next(json) == JSON_OBJECT_END;
+                ok &= json_get_context(json, &count) == JSON_ARRAY && count == (counts ? 3 : 1);
+                ok &= json_next(json) == JSON_NUMBER && json_next(json) == JSON_ARRAY_END;
+            }
+            ok &= json_next(json) == JSON_DONE;
+            json_close(json);
+        }
+        CHECK("counts", ok);
+    }
+
     {
         /* A value that failed to parse was never observed as an event,
            so it must not be counted against its container */